@@ -4,23 +4,26 @@
 
 #include "SRC/Util/StringUtil.h"
 
-#include "SRC/Networking/PacketNet.h"
+#include "SRC/Chat/ChatMessages.h"
 
 enum ClientCommand {
    CC_Connect,
    CC_Disconnect,
    CC_Exit,
+   CC_Join,
+   CC_Leave,
    CC_Message,
    CC_Test_F
 };
 
-class SimpleChatClient : public PN::PacketNetClient<> {
+class SimpleChatClient : public PN::MessageNetClient<Chat::Registry, PN::CompactPacket> {
 protected:
-   void onPacket(const PN::DefaultPacket& data) override {
-      std::cout << "[Server]: " << StringUtil::bytesToString(data.data) << std::endl;
+   void onMessage(const Chat::ChatLine& line) override {
+      std::cout << "[" << (line.room.empty() ? "Server" : line.room) << "]: " << line.text << std::endl;
    }
 
    void onConnect() override {
+      negotiation.offer = true;
       sendHandshake();
    }
 };
@@ -36,6 +39,10 @@ int main(int argc, const char** argv) {
       {"/c", CC_Connect},
       {"/stop", CC_Disconnect},
       {"/d", CC_Disconnect},
+      {"/join", CC_Join},
+      {"/j", CC_Join},
+      {"/leave", CC_Leave},
+      {"/l", CC_Leave},
       {"/e", CC_Exit},
       {"/exit", CC_Exit}
    };
@@ -47,6 +54,7 @@ int main(int argc, const char** argv) {
    NestedLoop nl;
 
    SimpleChatClient client;
+   std::string room(Chat::defaultRoom);
 
    for (;;) {
       std::getline(std::cin, msg);
@@ -85,9 +93,33 @@ int main(int argc, const char** argv) {
             client.disconnect();
             break;
          }
+         case CC_Join:
+         case CC_Leave: {
+            auto name = StringUtil::parseArg<std::string>(args, 0);
+            if(!name) {
+               std::cerr << "incorrect arg usage\n";
+               continue;
+            }
+
+            if(cmd == CC_Join) {
+               Chat::JoinRoom join;
+               join.room = *name;
+               client.sendMessage(join);
+               room = *name;
+            } else {
+               Chat::LeaveRoom leave;
+               leave.room = *name;
+               client.sendMessage(leave);
+               if(room == *name) room = Chat::defaultRoom;
+            }
+            break;
+         }
          default: {
             SN::StreamedNetClient::printClient(""+msg);
-            client.sendPacket(StringUtil::stringToBytes(msg));
+            Chat::ChatLine line;
+            line.room = room;
+            line.text = msg;
+            client.sendMessage(line);
             break;
          }
       }
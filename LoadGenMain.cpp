@@ -0,0 +1,243 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+   #include <sys/resource.h>
+#endif
+
+#include "SRC/Util/StringUtil.h"
+#include "SRC/Networking/PacketNet.h"
+
+// Loopback load generator: an in-process server relays every packet to all other
+// clients, packets carry their send time so each delivery yields one fan-out latency sample.
+//    LoadGen <port> [clients] [msgs/s] [payload bytes] [seconds] [client threads] [server threads]
+
+using Clock = std::chrono::steady_clock;
+
+static std::int64_t nanosSinceEpoch(Clock::time_point time) {
+   return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+struct LoadWorker {
+   asio::io_context context;
+   std::unique_ptr<asio::executor_work_guard<asio::io_context::executor_type>> work;
+   std::thread thr;
+
+   // Only touched by thr while the benchmark runs.
+   std::vector<std::uint64_t> latencies;
+   std::uint64_t bytes = 0;
+   Clock::time_point lastReceive{};
+};
+
+class LoadConnection : public PN::PacketNetConnection<> {
+public:
+   using PN::PacketNetConnection<>::PacketNetConnection;
+protected:
+   // Forwards everything one read held as a single shared buffer and write per peer.
+   void onPackets(std::span<const PN::PacketView> pkts) override {
+      getServer().broadcastFrame(PN::shareFrames(pkts, getBufferPool()), [this](const PN::PacketNetConnection<>& connection) {
+         return &connection != this;
+      });
+   }
+
+   void onStart() override {
+      batchPacketViews = true;
+      sendHandshake();
+   }
+
+   void onEvent(Event evt) override {}
+   void onError(Error err, const asio::error_code& ec) override {}
+};
+
+class LoadServer : public PN::PacketNetServer<> {
+protected:
+   std::shared_ptr<SN::StreamedNetConnection> onAccept(tcp::socket& socket) override {
+      return std::make_shared<LoadConnection>(this->getContext(), *this, socket);
+   }
+
+   void onError(Error err, const asio::error_code& ec) override {}
+};
+
+class LoadClient : public PN::PacketNetClient<> {
+public:
+   LoadClient(LoadWorker& worker, std::atomic<std::size_t>& connected, std::atomic<std::size_t>& failed) :
+      PN::PacketNetClient<>(worker.context), worker(worker), connected(connected), failed(failed) {
+      usePacketViews = true;
+   }
+
+protected:
+   void onConnect() override {
+      sendHandshake();
+      connected++;
+   }
+
+   void onPacketView(const PN::PacketView& pkt) override {
+      if (pkt.data.size() < sizeof(std::int64_t)) return;
+      std::int64_t sent;
+      std::memcpy(&sent, pkt.data.data(), sizeof(sent));
+      worker.lastReceive = Clock::now();
+      worker.latencies.emplace_back(nanosSinceEpoch(worker.lastReceive) - sent);
+      worker.bytes += pkt.frame.size();
+   }
+
+   void onEvent(Event evt) override {}
+   void onError(Error err, const asio::error_code& ec) override {
+      if (err == Error::ConnectFailed || err == Error::ResolveFailed) failed++;
+   }
+
+private:
+   LoadWorker& worker;
+   std::atomic<std::size_t>& connected;
+   std::atomic<std::size_t>& failed;
+};
+
+// Resident and peak resident set size in KiB, 0 where /proc is not available.
+static std::pair<std::size_t, std::size_t> readRss() {
+   std::ifstream status("/proc/self/status");
+   std::string line;
+   std::size_t rss = 0, peak = 0;
+   while (std::getline(status, line)) {
+      if (line.rfind("VmRSS:", 0) == 0) rss = std::stoull(line.substr(6));
+      else if (line.rfind("VmHWM:", 0) == 0) peak = std::stoull(line.substr(6));
+   }
+   return { rss, peak };
+}
+
+static void raiseFileLimit() {
+#ifndef _WIN32
+   rlimit limit{};
+   if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+      limit.rlim_cur = limit.rlim_max;
+      setrlimit(RLIMIT_NOFILE, &limit);
+   }
+#endif
+}
+
+static double percentileMs(const std::vector<std::uint64_t>& sorted, double quantile) {
+   if (sorted.empty()) return 0.0;
+   std::size_t idx = std::min(sorted.size() - 1, static_cast<std::size_t>(quantile * static_cast<double>(sorted.size())));
+   return static_cast<double>(sorted[idx]) / 1e6;
+}
+
+int main(int argc, const char** argv) {
+   std::vector<std::string> args(argv + 1, argv + argc);
+
+   auto port = StringUtil::parseArg<ushort_16>(args, 0);
+   if (!port) {
+      std::cerr << "usage: LoadGen <port> [clients] [msgs/s] [payload bytes] [seconds] [client threads] [server threads]\n";
+      return 1;
+   }
+   std::size_t clientCount = std::max<std::size_t>(StringUtil::parseArg<std::size_t>(args, 1).value_or(100), 2);
+   std::size_t rate = std::max<std::size_t>(StringUtil::parseArg<std::size_t>(args, 2).value_or(1000), 1);
+   std::size_t payload = std::max(StringUtil::parseArg<std::size_t>(args, 3).value_or(64), sizeof(std::int64_t));
+   std::size_t seconds = std::max<std::size_t>(StringUtil::parseArg<std::size_t>(args, 4).value_or(10), 1);
+   std::size_t clientThreads = std::max<std::size_t>(StringUtil::parseArg<std::size_t>(args, 5).value_or(2), 1);
+   std::size_t serverThreads = std::max<std::size_t>(StringUtil::parseArg<std::size_t>(args, 6).value_or(2), 1);
+
+   raiseFileLimit();
+   std::size_t rssStart = readRss().first;
+
+   LoadServer server;
+   server.setThreadCount(serverThreads);
+   server.start(*port);
+
+   // One thread per worker context: the client impl is not strand protected.
+   std::vector<std::unique_ptr<LoadWorker>> workers;
+   for (std::size_t i = 0; i < clientThreads; i++) {
+      auto& worker = workers.emplace_back(std::make_unique<LoadWorker>());
+      worker->work = std::make_unique<asio::executor_work_guard<asio::io_context::executor_type>>(worker->context.get_executor());
+      worker->thr = std::thread([w = worker.get()]() { w->context.run(); });
+   }
+
+   std::atomic<std::size_t> connected = 0;
+   std::atomic<std::size_t> failed = 0;
+   std::vector<std::unique_ptr<LoadClient>> clients;
+   for (std::size_t i = 0; i < clientCount; i++) {
+      clients.emplace_back(std::make_unique<LoadClient>(*workers[i % clientThreads], connected, failed));
+      clients.back()->autoConnect("127.0.0.1", *port);
+   }
+
+   auto connectDeadline = Clock::now() + std::chrono::seconds(30);
+   while (connected + failed < clientCount && Clock::now() < connectDeadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+   }
+   // Let the server side handshakes land before timing starts.
+   std::this_thread::sleep_for(std::chrono::milliseconds(200));
+   std::cout << "connected " << connected << "/" << clientCount << " failed " << failed << "\n";
+   if (connected < 2) {
+      std::cerr << "not enough clients connected\n";
+      return 1;
+   }
+   std::size_t rssConnected = readRss().first;
+
+   std::vector<ubyte_8> body(payload, 0x5A);
+   std::uint64_t sent = 0;
+   auto start = Clock::now();
+   auto end = start + std::chrono::seconds(seconds);
+   auto interval = std::chrono::nanoseconds(1000000000 / rate);
+   auto next = start;
+   while (Clock::now() < end) {
+      std::int64_t stamp = nanosSinceEpoch(Clock::now());
+      std::memcpy(body.data(), &stamp, sizeof(stamp));
+      clients[sent % clients.size()]->sendPacket(body);
+      sent++;
+
+      next += interval;
+      if (next > Clock::now()) std::this_thread::sleep_until(next);
+   }
+   auto sendEnd = Clock::now();
+
+   // Drain: wait until deliveries stop arriving.
+   std::this_thread::sleep_for(std::chrono::seconds(1));
+   auto serverMetrics = server.getMetrics();
+   auto [rssEnd, peakEnd] = readRss();
+
+   for (auto& client : clients) client->disconnect();
+   std::this_thread::sleep_for(std::chrono::milliseconds(100));
+   for (auto& worker : workers) {
+      worker->work.reset();
+      worker->context.stop();
+      worker->thr.join();
+   }
+   server.close();
+
+   std::vector<std::uint64_t> latencies;
+   std::uint64_t bytes = 0;
+   Clock::time_point lastReceive = start;
+   for (auto& worker : workers) {
+      latencies.insert(latencies.end(), worker->latencies.begin(), worker->latencies.end());
+      bytes += worker->bytes;
+      lastReceive = std::max(lastReceive, worker->lastReceive);
+   }
+   std::sort(latencies.begin(), latencies.end());
+
+   double sendSeconds = std::chrono::duration<double>(sendEnd - start).count();
+   double receiveSeconds = std::max(std::chrono::duration<double>(lastReceive - start).count(), 1e-9);
+   std::uint64_t expected = sent * (connected - 1);
+
+   std::cout << std::fixed << std::setprecision(3);
+   std::cout << "clients " << connected << " payload " << payload << " B target " << rate << " msgs/s\n";
+   std::cout << "sent " << sent << " (" << sent / sendSeconds << " msgs/s)\n";
+   std::cout << "delivered " << latencies.size() << "/" << expected << " (" << latencies.size() / receiveSeconds << " msgs/s, "
+      << bytes / receiveSeconds / (1024.0 * 1024.0) << " MB/s)\n";
+   std::cout << "fan-out latency ms p50 " << percentileMs(latencies, 0.5) << " p99 " << percentileMs(latencies, 0.99)
+      << " p999 " << percentileMs(latencies, 0.999) << " max " << percentileMs(latencies, 1.0) << "\n";
+   std::cout << "server write queue depth p50 " << serverMetrics.writeQueueDepth.percentile(0.5)
+      << " p99 " << serverMetrics.writeQueueDepth.percentile(0.99) << "\n";
+   if (rssEnd) {
+      std::cout << "rss KiB start " << rssStart << " connected " << rssConnected << " end " << rssEnd << " peak " << peakEnd
+         << " (server and clients share the process)\n";
+   } else {
+      std::cout << "rss n/a\n";
+   }
+   return 0;
+}
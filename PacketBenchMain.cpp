@@ -0,0 +1,366 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "SRC/Networking/MessageNet.h"
+
+// Microbenchmarks for the serialization templates and DefaultPacket framing.
+//    PacketBench                       print ns/op, bytes/op, allocs/op
+//    PacketBench --write <file>        store the results as a baseline
+//    PacketBench --check <file> [tol]  exit 1 if allocs/op or bytes/op grew, with tol also if ns/op grew more than tol percent
+
+static std::atomic<std::uint64_t> allocationCount{0};
+
+#if defined(_MSC_VER)
+#define PB_NOINLINE __declspec(noinline)
+#else
+#define PB_NOINLINE __attribute__((noinline))
+#endif
+
+// Every replaced operator new and delete goes through this pair. Kept out of line, so the
+// compiler does not see a malloc behind new and flag the matching deletes as mismatched.
+PB_NOINLINE static void* allocate(std::size_t size, std::size_t alignment) noexcept {
+   allocationCount.fetch_add(1, std::memory_order_relaxed);
+   if (size == 0) size = 1;
+   if (alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__) return std::malloc(size);
+#if defined(_MSC_VER)
+   return _aligned_malloc(size, alignment);
+#else
+   return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+#endif
+}
+
+PB_NOINLINE static void release(void* ptr, [[maybe_unused]] std::size_t alignment) noexcept {
+#if defined(_MSC_VER)
+   if (alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+      _aligned_free(ptr);
+      return;
+   }
+#endif
+   std::free(ptr);
+}
+
+static void* allocateOrThrow(std::size_t size, std::size_t alignment) {
+   if (void* ptr = allocate(size, alignment)) return ptr;
+   throw std::bad_alloc();
+}
+
+constexpr std::size_t defaultAlignment = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+
+void* operator new(std::size_t size) { return allocateOrThrow(size, defaultAlignment); }
+void* operator new[](std::size_t size) { return allocateOrThrow(size, defaultAlignment); }
+void* operator new(std::size_t size, std::align_val_t al) { return allocateOrThrow(size, static_cast<std::size_t>(al)); }
+void* operator new[](std::size_t size, std::align_val_t al) { return allocateOrThrow(size, static_cast<std::size_t>(al)); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return allocate(size, defaultAlignment); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return allocate(size, defaultAlignment); }
+void* operator new(std::size_t size, std::align_val_t al, const std::nothrow_t&) noexcept { return allocate(size, static_cast<std::size_t>(al)); }
+void* operator new[](std::size_t size, std::align_val_t al, const std::nothrow_t&) noexcept { return allocate(size, static_cast<std::size_t>(al)); }
+
+void operator delete(void* ptr) noexcept { release(ptr, defaultAlignment); }
+void operator delete[](void* ptr) noexcept { release(ptr, defaultAlignment); }
+void operator delete(void* ptr, std::size_t) noexcept { release(ptr, defaultAlignment); }
+void operator delete[](void* ptr, std::size_t) noexcept { release(ptr, defaultAlignment); }
+void operator delete(void* ptr, std::align_val_t al) noexcept { release(ptr, static_cast<std::size_t>(al)); }
+void operator delete[](void* ptr, std::align_val_t al) noexcept { release(ptr, static_cast<std::size_t>(al)); }
+void operator delete(void* ptr, std::size_t, std::align_val_t al) noexcept { release(ptr, static_cast<std::size_t>(al)); }
+void operator delete[](void* ptr, std::size_t, std::align_val_t al) noexcept { release(ptr, static_cast<std::size_t>(al)); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { release(ptr, defaultAlignment); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { release(ptr, defaultAlignment); }
+void operator delete(void* ptr, std::align_val_t al, const std::nothrow_t&) noexcept { release(ptr, static_cast<std::size_t>(al)); }
+void operator delete[](void* ptr, std::align_val_t al, const std::nothrow_t&) noexcept { release(ptr, static_cast<std::size_t>(al)); }
+
+using namespace PN;
+
+struct ChatMessage : Serializable {
+   std::string user;
+   std::string text;
+   ulong_64 time = 0;
+
+   SERIALIZABLE(user, text, time)
+};
+
+struct CompactChatMessage : ChatMessage {
+   constexpr static Encoding wireEncoding = Encoding::Varint;
+
+   SERIALIZABLE(user, text, time)
+};
+
+struct Vec3 {
+   float x, y, z;
+};
+
+struct Positions : Serializable {
+   ushort_16 id = 0;
+   std::vector<Vec3> points;
+
+   SERIALIZABLE(id, points)
+};
+
+struct Transform : Serializable {
+   ulong_64 entity = 0;
+   std::array<float, 3> position{};
+   std::array<float, 4> rotation{};
+   std::uint32_t flags = 0;
+
+   SERIALIZABLE_PACKED(entity, position, rotation, flags)
+};
+
+struct Room : Serializable {
+   std::string name;
+   ChatMessage pinned;
+   std::vector<ChatMessage> history;
+
+   SERIALIZABLE(name, pinned, history)
+};
+
+struct Scores : Serializable {
+   std::map<std::string, ulong_64> scores;
+
+   SERIALIZABLE(scores)
+};
+
+using BenchRegistry = MessageRegistry<MessageType<1, ChatMessage>, MessageType<2, Transform>>;
+
+struct BenchResult {
+   std::string name;
+   double nsPerOp = 0;
+   double bytesPerOp = 0;
+   double allocsPerOp = 0;
+};
+
+static std::uint64_t sink = 0;
+
+// Keeps the optimizer from dropping writes into objects that are never read.
+static void escape(const void* ptr) {
+#if defined(_MSC_VER)
+   static const void* volatile escaped = nullptr;
+   escaped = ptr;
+   escaped = nullptr;
+#else
+   asm volatile("" : : "g"(ptr) : "memory");
+#endif
+}
+
+// op returns the bytes it produced or consumed.
+template<typename Op>
+static BenchResult runBench(const std::string& name, Op&& op) {
+   using Clock = std::chrono::steady_clock;
+   for (int i = 0; i < 1000; i++) sink += op();
+
+   std::uint64_t iterations = 0;
+   std::uint64_t bytes = 0;
+   std::uint64_t allocsBefore = allocationCount.load(std::memory_order_relaxed);
+   auto start = Clock::now();
+   auto elapsed = Clock::duration::zero();
+   while (elapsed < std::chrono::milliseconds(200)) {
+      for (int i = 0; i < 1000; i++) bytes += op();
+      iterations += 1000;
+      elapsed = Clock::now() - start;
+   }
+   std::uint64_t allocs = allocationCount.load(std::memory_order_relaxed) - allocsBefore;
+   sink += bytes;
+
+   BenchResult result;
+   result.name = name;
+   result.nsPerOp = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / iterations;
+   result.bytesPerOp = static_cast<double>(bytes) / iterations;
+   result.allocsPerOp = static_cast<double>(allocs) / iterations;
+   return result;
+}
+
+template<typename T>
+static void benchMessage(std::vector<BenchResult>& results, const std::string& name, const T& msg) {
+   results.emplace_back(runBench(name + ".serialize", [&]() {
+      return msg.serialize().size();
+   }));
+
+   std::vector<ubyte_8> buf = msg.serialize();
+   results.emplace_back(runBench(name + ".deserialize", [&]() {
+      T out;
+      size_t offset = 0;
+      if (!out.deserialize(buf, offset)) std::abort();
+      escape(&out);
+      return offset;
+   }));
+}
+
+template<typename P = DefaultPacket>
+static void benchFraming(std::vector<BenchResult>& results, const std::string& name, const std::vector<ubyte_8>& payload) {
+   results.emplace_back(runBench(name + ".serialize", [&]() {
+      P pkt(payload);
+      return pkt.serialize().size();
+   }));
+
+   std::vector<ubyte_8> frame = P(payload).serialize();
+   StreamBuffer incoming;
+   results.emplace_back(runBench(name + ".parse", [&]() {
+      asio::mutable_buffer space = incoming.prepare(frame.size());
+      std::memcpy(space.data(), frame.data(), frame.size());
+      incoming.commit(frame.size());
+
+      P pkt;
+      if (decodeFrame(pkt, incoming) != FrameStatus::Complete) std::abort();
+      std::size_t size = pkt.readData(incoming).size();
+      pkt.erase(incoming);
+      return size;
+   }));
+}
+
+static std::vector<BenchResult> runAll() {
+   std::vector<BenchResult> results;
+
+   std::string text = "hey, is anyone around for a quick review?";
+   results.emplace_back(runBench("writeAny.string", [&]() {
+      std::vector<ubyte_8> buf;
+      writeAny(buf, text);
+      return buf.size();
+   }));
+   std::vector<ubyte_8> textBuf;
+   writeAny(textBuf, text);
+   results.emplace_back(runBench("readAny.string", [&]() {
+      std::string out;
+      ulong_64 offset = 0;
+      if (!readAny(textBuf, offset, out)) std::abort();
+      return offset;
+   }));
+
+   ChatMessage chat;
+   chat.user = "alice";
+   chat.text = text;
+   chat.time = 1700000000;
+   benchMessage(results, "chat", chat);
+
+   CompactChatMessage compactChat;
+   compactChat.user = chat.user;
+   compactChat.text = chat.text;
+   compactChat.time = chat.time;
+   benchMessage(results, "chatVarint", compactChat);
+
+   Positions positions;
+   positions.id = 7;
+   for (int i = 0; i < 256; i++) positions.points.push_back({ float(i), float(i) * 0.5f, -float(i) });
+   benchMessage(results, "podVector", positions);
+
+   Transform transform;
+   transform.entity = 42;
+   transform.position = { 1.0f, 2.0f, 3.0f };
+   transform.rotation = { 0.0f, 0.0f, 0.0f, 1.0f };
+   transform.flags = 3;
+   benchMessage(results, "packed", transform);
+
+   Room room;
+   room.name = "general";
+   room.pinned = chat;
+   for (int i = 0; i < 16; i++) room.history.push_back(chat);
+   benchMessage(results, "nested", room);
+
+   Scores scores;
+   for (int i = 0; i < 64; i++) scores.scores.emplace("player" + std::to_string(i), i * 100);
+   benchMessage(results, "map", scores);
+
+   std::vector<ubyte_8> tagged = BenchRegistry::encode(chat);
+   results.emplace_back(runBench("registry.dispatch", [&]() {
+      ulong_64 offset = 0;
+      ulong_64 id = 0;
+      if (!readVarint(tagged, offset, id)) std::abort();
+      if (!BenchRegistry::dispatch(id, tagged, offset, [](const auto& msg) { escape(&msg); })) std::abort();
+      return tagged.size();
+   }));
+
+   benchFraming(results, "frame.chat", chat.serialize());
+   results.emplace_back(runBench("frame.message.serialize", [&]() {
+      return frameMessage<DefaultPacket>(chat).size();
+   }));
+   benchFraming(results, "frame.16k", std::vector<ubyte_8>(16 * 1024, 0x5A));
+   benchFraming<CompactPacket>(results, "compact.chat", chat.serialize());
+   results.emplace_back(runBench("compact.msg.serialize", [&]() {
+      return frameMessage<CompactPacket>(chat).size();
+   }));
+   benchFraming<DelimitedPacket<>>(results, "delimited.line", std::vector<ubyte_8>(text.begin(), text.end()));
+
+   SN::FrameHistory history(64);
+   for (int i = 0; i < 64; i++) history.append(std::make_shared<const std::vector<ubyte_8>>(frameMessage<CompactPacket>(chat)));
+   results.emplace_back(runBench("history.replay64", [&]() {
+      std::size_t bytes = 0;
+      for (auto& frame : history.since(0)) bytes += frame->size();
+      return bytes;
+   }));
+   return results;
+}
+
+static std::map<std::string, BenchResult> readBaseline(const std::string& path) {
+   std::map<std::string, BenchResult> baseline;
+   std::ifstream in(path);
+   std::string line;
+   while (std::getline(in, line)) {
+      if (line.empty() || line[0] == '#') continue;
+      std::istringstream fields(line);
+      BenchResult result;
+      if (fields >> result.name >> result.nsPerOp >> result.bytesPerOp >> result.allocsPerOp) baseline[result.name] = result;
+   }
+   return baseline;
+}
+
+int main(int argc, const char** argv) {
+   std::vector<std::string> args(argv + 1, argv + argc);
+   std::vector<BenchResult> results = runAll();
+
+   std::cout << std::left << std::setw(24) << "benchmark" << std::right << std::setw(12) << "ns/op" << std::setw(12) << "bytes/op"
+      << std::setw(12) << "allocs/op" << "\n" << std::fixed;
+   for (auto& result : results) {
+      std::cout << std::left << std::setw(24) << result.name << std::right << std::setprecision(1) << std::setw(12) << result.nsPerOp
+         << std::setw(12) << result.bytesPerOp << std::setprecision(2) << std::setw(12) << result.allocsPerOp << "\n";
+   }
+
+   if (args.size() >= 2 && args[0] == "--write") {
+      std::ofstream out(args[1]);
+      out << "# name ns/op bytes/op allocs/op, ns/op is machine specific: refresh with PacketBench --write on the machine that runs --check with a tolerance\n";
+      out << std::fixed;
+      for (auto& result : results) {
+         out << result.name << " " << std::setprecision(1) << result.nsPerOp << " " << result.bytesPerOp << " "
+            << std::setprecision(2) << result.allocsPerOp << "\n";
+      }
+      return 0;
+   }
+
+   if (args.size() >= 2 && args[0] == "--check") {
+      std::map<std::string, BenchResult> baseline = readBaseline(args[1]);
+      if (baseline.empty()) {
+         std::cerr << "no baseline in " << args[1] << "\n";
+         return 1;
+      }
+      // ns/op only means something on the machine that wrote the baseline, so timing is opt-in.
+      bool checkTime = args.size() >= 3;
+      double tolerance = checkTime ? std::atof(args[2].c_str()) : 0.0;
+
+      bool failed = false;
+      for (auto& result : results) {
+         auto it = baseline.find(result.name);
+         if (it == baseline.end()) continue;
+         const BenchResult& base = it->second;
+         if (result.allocsPerOp > base.allocsPerOp + 0.01) {
+            std::cerr << result.name << ": allocs/op " << result.allocsPerOp << " > " << base.allocsPerOp << "\n";
+            failed = true;
+         }
+         if (result.bytesPerOp > base.bytesPerOp + 0.01) {
+            std::cerr << result.name << ": bytes/op " << result.bytesPerOp << " > " << base.bytesPerOp << "\n";
+            failed = true;
+         }
+         if (checkTime && base.nsPerOp > 0 && result.nsPerOp > base.nsPerOp * (1.0 + tolerance / 100.0)) {
+            std::cerr << result.name << ": ns/op " << result.nsPerOp << " > " << base.nsPerOp << " +" << tolerance << "%\n";
+            failed = true;
+         }
+      }
+      return failed ? 1 : 0;
+   }
+   return sink == 0 ? 1 : 0;
+}
@@ -0,0 +1,193 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SRC/Networking/MessageNet.h"
+
+// Decode checks for the frame formats and room history checks over loopback, exits 1 if
+// any of them fails. Run by ctest.
+
+using namespace PN;
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+   if (ok) return;
+   std::cerr << "FAILED: " << what << "\n";
+   failures++;
+}
+
+template<typename P>
+static FrameStatus decode(const std::vector<ubyte_8>& frame) {
+   StreamBuffer incoming;
+   asio::mutable_buffer space = incoming.prepare(frame.size());
+   std::memcpy(space.data(), frame.data(), frame.size());
+   incoming.commit(frame.size());
+
+   P pkt;
+   FrameStatus status = decodeFrame(pkt, incoming);
+   if (status == FrameStatus::Complete) pkt.readData(incoming);
+   return status;
+}
+
+static void compactFrames() {
+   std::vector<ubyte_8> payload{ 1, 2, 3 };
+   std::vector<ubyte_8> frame = CompactPacket(payload, 7).serialize();
+   check(decode<CompactPacket>(frame) == FrameStatus::Complete, "compact frame decodes");
+   frame.pop_back();
+   check(decode<CompactPacket>(frame) == FrameStatus::Incomplete, "truncated compact frame waits for more");
+
+   // header + len wraps around to a tiny frame size
+   std::vector<ubyte_8> wrapping{ CompactPacket::marker, 0 };
+   writeVarint(wrapping, std::numeric_limits<ulong_64>::max() - 3);
+   writeVarint(wrapping, 0);
+   check(decode<CompactPacket>(wrapping) == FrameStatus::Malformed, "compact length that overflows the size check");
+
+   // eleven varint bytes do not fit 64 bits
+   std::vector<ubyte_8> tooLong{ CompactPacket::marker, 0 };
+   for (int i = 0; i < 10; i++) tooLong.push_back(0xFF);
+   tooLong.push_back(0x01);
+   check(decode<CompactPacket>(tooLong) == FrameStatus::Malformed, "compact length varint longer than 64 bits");
+
+   // the writer's length slot holds at most maxPacketSize
+   FrameWriter<CompactPacket> writer;
+   writer.payload().resize(writer.payload().size() + CompactPacket::maxPacketSize + 1);
+   bool refused = false;
+   try {
+      writer.finish();
+   } catch (const std::length_error&) {
+      refused = true;
+   }
+   check(refused, "compact frame writer refuses a payload above maxPacketSize");
+
+   std::vector<ubyte_8> tooLarge{ CompactPacket::marker, 0 };
+   writeVarint(tooLarge, CompactPacket::maxPacketSize);
+   writeVarint(tooLarge, 0);
+   check(decode<CompactPacket>(tooLarge) == FrameStatus::Malformed, "compact length above maxPacketSize");
+}
+
+static void defaultFrames() {
+   std::vector<ubyte_8> payload{ 1, 2, 3 };
+   std::vector<ubyte_8> frame = DefaultPacket(payload).serialize();
+   check(decode<DefaultPacket>(frame) == FrameStatus::Complete, "default frame decodes");
+   check(decode<CompactPacket>(frame) == FrameStatus::Complete, "default frame decodes as legacy compact");
+
+   ulong_64 len = std::numeric_limits<ulong_64>::max() - 8;
+   std::memcpy(frame.data() + DefaultPacket::headSpecifier.size(), &len, 8);
+   check(decode<DefaultPacket>(frame) == FrameStatus::Malformed, "default length that overflows the size check");
+   check(decode<CompactPacket>(frame) == FrameStatus::Malformed, "legacy length that overflows the size check");
+}
+
+struct HistoryConnection : PacketNetConnection<CompactPacket> {
+   using PacketNetConnection::PacketNetConnection;
+   // The first packet sent doubles as the handshake otherwise.
+   void onStart() override { sendHandshake(); }
+   void onEvent(Event evt) override {}
+   void onError(Error err, const asio::error_code& ec) override {}
+};
+
+struct HistoryServer : PacketNetServer<CompactPacket> {
+   std::shared_ptr<SN::StreamedNetConnection> onAccept(tcp::socket& socket) override {
+      return std::make_shared<HistoryConnection>(getContext(), *this, socket);
+   }
+   void onEvent(Event evt) override {}
+   void onError(Error err, const asio::error_code& ec) override {}
+};
+
+struct HistoryClient : PacketNetClient<CompactPacket> {
+   void onPacket(const CompactPacket& pkt) override {
+      std::lock_guard<std::mutex> lock(mutex);
+      received += std::string(pkt.data.begin(), pkt.data.end()) + " ";
+   }
+   void onEvent(Event evt) override {}
+   void onError(Error err, const asio::error_code& ec) override {}
+
+   std::string take() {
+      std::lock_guard<std::mutex> lock(mutex);
+      return std::exchange(received, std::string());
+   }
+
+   std::mutex mutex;
+   std::string received;
+};
+
+template<typename F>
+static bool waitFor(F&& done) {
+   auto until = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+   while (!done()) {
+      if (std::chrono::steady_clock::now() > until) return false;
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+   }
+   return true;
+}
+
+static CompactPacket text(const std::string& s) {
+   return CompactPacket(std::vector<ubyte_8>(s.begin(), s.end()));
+}
+
+// Waits until client received expected, or for a moment if nothing is expected.
+static std::string receive(HistoryClient& client, const std::string& expected) {
+   std::string got;
+   auto wanted = [&]() { got += client.take(); return got.size() >= expected.size(); };
+   if (expected.empty()) std::this_thread::sleep_for(std::chrono::milliseconds(100));
+   else waitFor(wanted);
+   got += client.take();
+   return got;
+}
+
+static void roomHistories() {
+   const ushort_16 port = 47311;
+   HistoryServer server;
+   server.setHistory(3, std::numeric_limits<std::size_t>::max(), 2);
+   server.start(port);
+   HistoryClient client;
+   client.autoConnect("127.0.0.1", port);
+   bool connected = waitFor([&]() { return server.getConnections().size() == 1; });
+   check(connected, "history client connects");
+   if (!connected) {
+      client.disconnect();
+      server.close();
+      return;
+   }
+   auto connection = server.getConnections().front();
+
+   check(server.joinAndReplay("r", *connection) == 0, "empty room replays nothing");
+   server.publish("r", text("m1"));
+   server.publish("r", text("m2"));
+   check(receive(client, "m1 m2 ") == "m1 m2 ", "members get live frames");
+
+   std::uint64_t since = server.getHistorySequence("r");
+   check(server.leave("r", *connection), "leave");
+   server.publish("r", text("m3"));
+   server.publish("r", text("m4"));
+   check(receive(client, "") == "", "left room sends nothing");
+   since = server.joinAndReplay("r", *connection, since);
+   check(receive(client, "m3 m4 ") == "m3 m4 ", "rejoin resumes with frames published while the room was empty");
+
+   // Two other rooms evict the history of r, numbering goes on regardless.
+   server.leave("r", *connection);
+   server.publish("x", text("x1"));
+   server.publish("y", text("y1"));
+   server.publish("r", text("m5"));
+   check(server.getHistorySequence("r") > since, "numbering outlives an evicted history");
+   server.joinAndReplay("r", *connection, since);
+   check(receive(client, "m5 ") == "m5 ", "resume after eviction replays the newer frames only");
+
+   client.disconnect();
+   server.close();
+}
+
+int main() {
+   compactFrames();
+   defaultFrames();
+   roomHistories();
+   if (failures == 0) std::cout << "all decode and history checks passed\n";
+   return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,43 @@
+#ifndef CHAT_CHAT_MESSAGES_H
+#define CHAT_CHAT_MESSAGES_H
+
+#include <string>
+#include <string_view>
+
+#include "../Networking/MessageNet.h"
+
+namespace Chat {
+   using PN::ubyte_8;
+
+   // Every connection starts out in this room.
+   constexpr std::string_view defaultRoom = "general";
+
+   // A line said in room, lines the server console broadcasts have no room.
+   struct ChatLine : PN::Serializable {
+      std::string room;
+      std::string text;
+
+      SERIALIZABLE(room, text)
+   };
+
+   struct JoinRoom : PN::Serializable {
+      std::string room;
+
+      SERIALIZABLE(room)
+   };
+
+   struct LeaveRoom : PN::Serializable {
+      std::string room;
+
+      SERIALIZABLE(room)
+   };
+
+   // Messages SimpleChat clients and servers exchange after the handshake.
+   using Registry = PN::MessageRegistry<
+      PN::MessageType<1, ChatLine>,
+      PN::MessageType<2, JoinRoom>,
+      PN::MessageType<3, LeaveRoom>
+   >;
+}
+
+#endif //CHAT_CHAT_MESSAGES_H
@@ -0,0 +1,150 @@
+#ifndef NETWORK_BUFFER_POOL_H
+#define NETWORK_BUFFER_POOL_H
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace SN {
+   using ubyte_8 = std::uint8_t;
+   // Immutable frame that many write queues can reference without copying.
+   using SharedBuffer = std::shared_ptr<const std::vector<ubyte_8>>;
+
+   // Recycles byte vectors by power of two size classes (256 B .. 128 KiB).
+   // Free lists are striped per thread so io threads rarely share a lock;
+   // larger requests bypass the pool. Derive and override acquire/release to
+   // plug in another strategy. A pool must outlive the buffers it shared.
+   class BufferPool {
+   public:
+      constexpr static std::size_t minClassSize = 256;
+      constexpr static std::size_t classCount = 10;
+      constexpr static std::size_t maxClassSize = minClassSize << (classCount - 1);
+      constexpr static std::size_t threadCacheCount = 16;
+
+      struct Stats {
+         std::uint64_t acquired = 0;
+         std::uint64_t released = 0;
+         std::uint64_t reused = 0;
+         std::uint64_t allocated = 0;
+         std::uint64_t dropped = 0;
+         std::uint64_t cachedBytes = 0;
+      };
+
+      explicit BufferPool(std::size_t maxCachedPerClass = 64) : maxCachedPerClass(maxCachedPerClass) {}
+      virtual ~BufferPool() = default;
+
+      BufferPool(const BufferPool&) = delete;
+      BufferPool& operator=(const BufferPool&) = delete;
+
+      static BufferPool& defaultPool() {
+         static BufferPool* pool = new BufferPool();
+         return *pool;
+      }
+
+      // Returns an empty vector whose capacity is at least minCapacity.
+      virtual std::vector<ubyte_8> acquire(std::size_t minCapacity) {
+         acquiredCount.fetch_add(1, std::memory_order_relaxed);
+         std::size_t cls = classFor(minCapacity);
+         if (cls < classCount) {
+            Cache& cache = localCache();
+            std::lock_guard<std::mutex> lock(cache.mutex);
+            auto& list = cache.free[cls];
+            if (!list.empty()) {
+               std::vector<ubyte_8> buf = std::move(list.back());
+               list.pop_back();
+               reusedCount.fetch_add(1, std::memory_order_relaxed);
+               cachedBytes.fetch_sub(buf.capacity(), std::memory_order_relaxed);
+               return buf;
+            }
+         }
+         allocatedCount.fetch_add(1, std::memory_order_relaxed);
+         std::vector<ubyte_8> buf;
+         buf.reserve(cls < classCount ? classSize(cls) : minCapacity);
+         return buf;
+      }
+
+      virtual void release(std::vector<ubyte_8>&& buf) {
+         std::size_t capacity = buf.capacity();
+         if (capacity == 0) return;
+         releasedCount.fetch_add(1, std::memory_order_relaxed);
+         if (capacity < minClassSize || capacity > maxClassSize) {
+            droppedCount.fetch_add(1, std::memory_order_relaxed);
+            return;
+         }
+         std::size_t cls = classFor(capacity);
+         if (classSize(cls) > capacity) cls--;
+
+         Cache& cache = localCache();
+         std::lock_guard<std::mutex> lock(cache.mutex);
+         auto& list = cache.free[cls];
+         if (list.size() >= maxCachedPerClass) {
+            droppedCount.fetch_add(1, std::memory_order_relaxed);
+            return;
+         }
+         buf.clear();
+         cachedBytes.fetch_add(capacity, std::memory_order_relaxed);
+         list.emplace_back(std::move(buf));
+      }
+
+      // Wraps buf as a SharedBuffer that hands its storage back once the last reference drops.
+      SharedBuffer share(std::vector<ubyte_8>&& buf) {
+         auto holder = std::make_shared<Pooled>(*this, std::move(buf));
+         return SharedBuffer(holder, &holder->buf);
+      }
+
+      Stats getStats() const {
+         Stats stats;
+         stats.acquired = acquiredCount.load(std::memory_order_relaxed);
+         stats.released = releasedCount.load(std::memory_order_relaxed);
+         stats.reused = reusedCount.load(std::memory_order_relaxed);
+         stats.allocated = allocatedCount.load(std::memory_order_relaxed);
+         stats.dropped = droppedCount.load(std::memory_order_relaxed);
+         stats.cachedBytes = cachedBytes.load(std::memory_order_relaxed);
+         return stats;
+      }
+
+   private:
+      struct Cache {
+         std::mutex mutex;
+         std::array<std::vector<std::vector<ubyte_8>>, classCount> free;
+      };
+
+      struct Pooled {
+         Pooled(BufferPool& pool, std::vector<ubyte_8>&& buf) : pool(pool), buf(std::move(buf)) {}
+         ~Pooled() { pool.release(std::move(buf)); }
+
+         BufferPool& pool;
+         std::vector<ubyte_8> buf;
+      };
+
+      static std::size_t classSize(std::size_t cls) {
+         return minClassSize << cls;
+      }
+
+      static std::size_t classFor(std::size_t size) {
+         std::size_t cls = 0;
+         while (cls < classCount && classSize(cls) < size) cls++;
+         return cls;
+      }
+
+      Cache& localCache() {
+         static std::atomic<std::size_t> nextSlot{0};
+         thread_local std::size_t slot = nextSlot.fetch_add(1, std::memory_order_relaxed);
+         return caches[slot % threadCacheCount];
+      }
+
+      std::size_t maxCachedPerClass;
+      std::array<Cache, threadCacheCount> caches;
+
+      std::atomic<std::uint64_t> acquiredCount{0};
+      std::atomic<std::uint64_t> releasedCount{0};
+      std::atomic<std::uint64_t> reusedCount{0};
+      std::atomic<std::uint64_t> allocatedCount{0};
+      std::atomic<std::uint64_t> droppedCount{0};
+      std::atomic<std::uint64_t> cachedBytes{0};
+   };
+}
+
+#endif //NETWORK_BUFFER_POOL_H
@@ -0,0 +1,146 @@
+#ifndef NETWORK_CONNECTION_REGISTRY_H
+#define NETWORK_CONNECTION_REGISTRY_H
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace SN {
+   // Slot index in the low 32 bits, the slot's generation in the high 32, so the id of a
+   // removed entry never matches the one that reuses its slot.
+   using ConnectionId = std::uint64_t;
+   constexpr ConnectionId invalidConnectionId = ~ConnectionId(0);
+
+   // Slot map of live entries: add, remove and lookup by id are O(1). snapshot() hands out
+   // an immutable list that is rebuilt at most once per change, readers that find it
+   // current neither lock nor copy. Every change drops the cached list, so it never keeps
+   // a removed entry alive; snapshots already handed out still do.
+   template<typename T>
+   class ConnectionRegistry {
+   public:
+      using List = std::vector<std::shared_ptr<T>>;
+      using Snapshot = std::shared_ptr<const List>;
+
+      ConnectionId add(std::shared_ptr<T> item) {
+         std::shared_ptr<const Cached> stale;
+         std::lock_guard<std::mutex> lock(mutex);
+         std::uint32_t index;
+         if (!freeSlots.empty()) {
+            index = freeSlots.back();
+            freeSlots.pop_back();
+         } else {
+            index = static_cast<std::uint32_t>(slots.size());
+            slots.emplace_back();
+         }
+         slots[index].item = std::move(item);
+         count.fetch_add(1, std::memory_order_relaxed);
+         stale = changed();
+         return makeId(index, slots[index].generation);
+      }
+
+      // The removed entry, null if id is not registered (anymore).
+      std::shared_ptr<T> remove(ConnectionId id) {
+         std::shared_ptr<const Cached> stale;
+         std::lock_guard<std::mutex> lock(mutex);
+         Slot* slot = find(id);
+         if (!slot) return nullptr;
+         std::shared_ptr<T> item = std::move(slot->item);
+         slot->item.reset();
+         slot->generation++;
+         freeSlots.push_back(static_cast<std::uint32_t>(id));
+         count.fetch_sub(1, std::memory_order_relaxed);
+         stale = changed();
+         return item;
+      }
+
+      std::shared_ptr<T> get(ConnectionId id) {
+         std::lock_guard<std::mutex> lock(mutex);
+         Slot* slot = find(id);
+         return slot ? slot->item : nullptr;
+      }
+
+      // Takes every entry out, their ids become invalid.
+      List clear() {
+         std::shared_ptr<const Cached> stale;
+         std::lock_guard<std::mutex> lock(mutex);
+         List out;
+         out.reserve(count.load(std::memory_order_relaxed));
+         freeSlots.clear();
+         for (std::size_t i = slots.size(); i-- > 0;) {
+            if (slots[i].item) {
+               out.emplace_back(std::move(slots[i].item));
+               slots[i].item.reset();
+               slots[i].generation++;
+            }
+            freeSlots.push_back(static_cast<std::uint32_t>(i));
+         }
+         count.store(0, std::memory_order_relaxed);
+         stale = changed();
+         return out;
+      }
+
+      std::size_t size() const {
+         return count.load(std::memory_order_relaxed);
+      }
+
+      Snapshot snapshot() {
+         std::shared_ptr<const Cached> current = cached.load(std::memory_order_acquire);
+         if (!current || current->version != version.load(std::memory_order_acquire)) {
+            std::lock_guard<std::mutex> lock(mutex);
+            current = cached.load(std::memory_order_acquire);
+            std::uint64_t now = version.load(std::memory_order_relaxed);
+            if (!current || current->version != now) {
+               auto rebuilt = std::make_shared<Cached>();
+               rebuilt->version = now;
+               rebuilt->list.reserve(count.load(std::memory_order_relaxed));
+               for (auto& slot : slots) {
+                  if (slot.item) rebuilt->list.emplace_back(slot.item);
+               }
+               current = std::move(rebuilt);
+               cached.store(current, std::memory_order_release);
+            }
+         }
+         return Snapshot(current, &current->list);
+      }
+
+   private:
+      struct Slot {
+         std::shared_ptr<T> item;
+         std::uint32_t generation = 0;
+      };
+
+      struct Cached {
+         std::uint64_t version = 0;
+         List list;
+      };
+
+      // Called under mutex. The old list is handed back to be released after unlocking,
+      // it may hold the last reference to an entry.
+      std::shared_ptr<const Cached> changed() {
+         version.fetch_add(1, std::memory_order_release);
+         return cached.exchange(nullptr, std::memory_order_acq_rel);
+      }
+
+      static ConnectionId makeId(std::uint32_t index, std::uint32_t generation) {
+         return static_cast<ConnectionId>(generation) << 32 | index;
+      }
+
+      Slot* find(ConnectionId id) {
+         std::uint32_t index = static_cast<std::uint32_t>(id);
+         if (index >= slots.size()) return nullptr;
+         Slot& slot = slots[index];
+         if (!slot.item || slot.generation != static_cast<std::uint32_t>(id >> 32)) return nullptr;
+         return &slot;
+      }
+
+      std::mutex mutex;
+      std::vector<Slot> slots;
+      std::vector<std::uint32_t> freeSlots;
+      std::atomic<std::size_t> count = 0;
+      std::atomic<std::uint64_t> version = 0;
+      std::atomic<std::shared_ptr<const Cached>> cached;
+   };
+}
+
+#endif //NETWORK_CONNECTION_REGISTRY_H
@@ -0,0 +1,111 @@
+#ifndef NETWORK_FRAME_HISTORY_H
+#define NETWORK_FRAME_HISTORY_H
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "BufferPool.h"
+
+namespace SN {
+   // Ring of the most recent frames, numbered in append order: from 1, or by the caller,
+   // e.g. with FrameLog sequence numbers. Holds at most capacity frames and maxBytes of
+   // frame data, the oldest ones make room. Frames are shared, not copied, so replaying
+   // one costs a reference count. Not synchronized.
+   class FrameHistory {
+   public:
+      explicit FrameHistory(std::size_t capacity, std::size_t maxBytes = std::numeric_limits<std::size_t>::max())
+         : ring(capacity), maxBytes(maxBytes) {}
+
+      // The sequence number of frame, 0 if the history holds no frames at all.
+      std::uint64_t append(SharedBuffer frame) {
+         return append(std::move(frame), lastSeq + 1);
+      }
+
+      // Numbers frame seq, which has to be above lastSequence().
+      std::uint64_t append(SharedBuffer frame, std::uint64_t seq) {
+         if (ring.empty()) return 0;
+         if (count == ring.size()) popOldest();
+         bytes += frame->size();
+         ring[(first + count) % ring.size()] = { std::move(frame), seq };
+         count++;
+         while (bytes > maxBytes && count > 1) popOldest();
+         lastSeq = seq;
+         return seq;
+      }
+
+      // Later frames are numbered above seq, e.g. after frames that went elsewhere.
+      void skipTo(std::uint64_t seq) {
+         lastSeq = std::max(lastSeq, seq);
+      }
+
+      // Like skipTo, but the frames up to seq count as dropped, e.g. ones never appended.
+      void dropTo(std::uint64_t seq) {
+         skipTo(seq);
+         droppedSeq = std::max(droppedSeq, seq);
+      }
+
+      // Retained frames numbered above since, oldest first.
+      std::vector<SharedBuffer> since(std::uint64_t since) const {
+         // Numbers grow along the ring, the first one above since is found by bisection.
+         std::size_t low = 0, high = count;
+         while (low < high) {
+            std::size_t mid = (low + high) / 2;
+            if (at(mid).seq <= since) low = mid + 1;
+            else high = mid;
+         }
+         return from(low);
+      }
+
+      // The newest n frames, oldest first.
+      std::vector<SharedBuffer> last(std::size_t n) const {
+         return from(n >= count ? 0 : count - n);
+      }
+
+      void clear() {
+         while (count > 0) popOldest();
+      }
+
+      std::uint64_t lastSequence() const { return lastSeq; }
+      // Newest frame that was appended and no longer is retained, 0 if none. since() is
+      // complete for every since at or above it.
+      std::uint64_t droppedSequence() const { return droppedSeq; }
+      std::size_t size() const { return count; }
+      std::size_t byteSize() const { return bytes; }
+
+   private:
+      struct Entry {
+         SharedBuffer frame;
+         std::uint64_t seq = 0;
+      };
+
+      const Entry& at(std::size_t i) const {
+         return ring[(first + i) % ring.size()];
+      }
+
+      std::vector<SharedBuffer> from(std::size_t skip) const {
+         std::vector<SharedBuffer> out;
+         out.reserve(count - skip);
+         for (std::size_t i = skip; i < count; i++) out.emplace_back(at(i).frame);
+         return out;
+      }
+
+      void popOldest() {
+         bytes -= ring[first].frame->size();
+         droppedSeq = ring[first].seq;
+         ring[first].frame.reset();
+         first = (first + 1) % ring.size();
+         count--;
+      }
+
+      std::vector<Entry> ring;
+      std::size_t maxBytes;
+      std::size_t first = 0;
+      std::size_t count = 0;
+      std::size_t bytes = 0;
+      std::uint64_t lastSeq = 0;
+      std::uint64_t droppedSeq = 0;
+   };
+}
+
+#endif //NETWORK_FRAME_HISTORY_H
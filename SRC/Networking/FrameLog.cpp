@@ -0,0 +1,459 @@
+#include "FrameLog.h"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <limits>
+
+#ifndef _WIN32
+   #include <fcntl.h>
+   #include <sys/mman.h>
+   #include <sys/stat.h>
+   #include <unistd.h>
+#endif
+
+using namespace SN;
+
+// Record: u32 size, u32 checksum, u64 seq, u16 key size, key, frame. size covers the whole
+// record, the checksum everything after it. A zero size marks the end of a segment.
+constexpr std::size_t headerSize = 4 + 4 + 8 + 2;
+constexpr std::size_t maxKeySize = 0xFFFF;
+constexpr const char* segmentExtension = ".log";
+
+static std::uint32_t checksum(const ubyte_8* data, std::size_t size) {
+   std::uint32_t hash = 2166136261u;
+   for (std::size_t i = 0; i < size; i++) {
+      hash ^= data[i];
+      hash *= 16777619u;
+   }
+   return hash;
+}
+
+template<typename V>
+static V load(const ubyte_8* data) {
+   V value;
+   std::memcpy(&value, data, sizeof(V));
+   return value;
+}
+
+template<typename V>
+static void store(ubyte_8* data, V value) {
+   std::memcpy(data, &value, sizeof(V));
+}
+
+// Size of the valid record at offset, 0 at the end of the records or at a torn one.
+static std::size_t recordAt(const ubyte_8* data, std::size_t limit, std::size_t offset, std::uint64_t& seq) {
+   if (limit - offset < headerSize) return 0;
+   const ubyte_8* record = data + offset;
+   std::size_t size = load<std::uint32_t>(record);
+   if (size < headerSize || size > limit - offset) return 0;
+   if (headerSize + load<std::uint16_t>(record + 16) > size) return 0;
+   if (load<std::uint32_t>(record + 4) != checksum(record + 8, size - 8)) return 0;
+   seq = load<std::uint64_t>(record + 8);
+   return size;
+}
+
+static std::string segmentName(std::uint64_t baseSeq) {
+   std::string digits = std::to_string(baseSeq);
+   return std::string(20 - std::min<std::size_t>(digits.size(), 20), '0') + digits + segmentExtension;
+}
+
+struct FrameLog::Segment {
+   std::filesystem::path path;
+   std::uint64_t baseSeq = 0;
+   ubyte_8* data = nullptr;
+   std::size_t size = 0;
+   int fd = -1;
+   // Bytes of complete records, readers stop there.
+   std::atomic<std::size_t> end = 0;
+   // Writer only: bytes already synced.
+   std::size_t synced = 0;
+   // Under segmentsMutex.
+   std::vector<IndexEntry> index;
+
+   // Maps path read-write, sized to size if it is created.
+   bool map(bool create, std::size_t createSize) {
+#ifndef _WIN32
+      fd = ::open(path.c_str(), create ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR, 0644);
+      if (fd < 0) return false;
+      if (create && ::ftruncate(fd, static_cast<off_t>(createSize)) != 0) return false;
+      struct stat st {};
+      if (::fstat(fd, &st) != 0) return false;
+      size = static_cast<std::size_t>(st.st_size);
+      if (size == 0) return true;
+      void* mapped = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      if (mapped == MAP_FAILED) return false;
+      data = static_cast<ubyte_8*>(mapped);
+      return true;
+#else
+      return false;
+#endif
+   }
+
+   bool sync(std::size_t upTo) {
+#ifndef _WIN32
+      if (upTo <= synced) return true;
+      std::size_t page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+      std::size_t from = synced / page * page;
+      if (::msync(data + from, upTo - from, MS_SYNC) != 0) return false;
+      synced = upTo;
+      return true;
+#else
+      return false;
+#endif
+   }
+
+   ~Segment() {
+#ifndef _WIN32
+      if (data) ::munmap(data, size);
+      if (fd >= 0) ::close(fd);
+#endif
+   }
+};
+
+// Makes a new segment file's directory entry durable.
+static void syncDirectory(const std::filesystem::path& dir) {
+#ifndef _WIN32
+   int fd = ::open(dir.c_str(), O_RDONLY);
+   if (fd < 0) return;
+   ::fsync(fd);
+   ::close(fd);
+#endif
+}
+
+FrameLog::~FrameLog() {
+   close();
+}
+
+bool FrameLog::open(const std::filesystem::path& directory) {
+   return open(directory, Options());
+}
+
+bool FrameLog::open(const std::filesystem::path& directory, Options opts) {
+   if (opened || writer.joinable()) {
+      setError("already open");
+      return false;
+   }
+#ifdef _WIN32
+   setError("FrameLog needs mmap, it is not supported on Windows");
+   return false;
+#else
+   dir = directory;
+   options = opts;
+   options.indexInterval = std::max<std::size_t>(options.indexInterval, 1);
+   setError({});
+   if (options.segmentSize <= headerSize) {
+      setError("segment size too small");
+      return false;
+   }
+
+   std::error_code fsError;
+   std::filesystem::create_directories(dir, fsError);
+   if (fsError) {
+      setError(dir.string() + ": " + fsError.message());
+      return false;
+   }
+   if (!recover()) return false;
+
+   stopping = false;
+   syncRequested = false;
+   lastSync = std::chrono::steady_clock::now();
+   opened = true;
+   writer = std::thread([this]() { writerLoop(); });
+   return true;
+#endif
+}
+
+bool FrameLog::recover() {
+   std::vector<std::pair<std::uint64_t, std::filesystem::path>> found;
+   std::error_code fsError;
+   for (auto& entry : std::filesystem::directory_iterator(dir, fsError)) {
+      if (!entry.is_regular_file() || entry.path().extension() != segmentExtension) continue;
+      std::string stem = entry.path().stem().string();
+      std::uint64_t baseSeq = 0;
+      auto [end, ec] = std::from_chars(stem.data(), stem.data() + stem.size(), baseSeq);
+      if (ec != std::errc() || end != stem.data() + stem.size() || baseSeq == 0) continue;
+      found.emplace_back(baseSeq, entry.path());
+   }
+   if (fsError) {
+      setError(dir.string() + ": " + fsError.message());
+      return false;
+   }
+   std::sort(found.begin(), found.end());
+
+   std::lock_guard<std::mutex> lock(segmentsMutex);
+   segments.clear();
+   std::uint64_t expected = found.empty() ? 1 : found.front().first;
+   sinceIndexed = 0;
+   bool broken = false;
+   for (auto& [baseSeq, path] : found) {
+      if (broken || baseSeq != expected) {
+         // Everything after a damaged segment would leave a gap in the numbering.
+         broken = true;
+         std::filesystem::remove(path, fsError);
+         continue;
+      }
+
+      auto segment = std::make_shared<Segment>();
+      segment->path = path;
+      segment->baseSeq = baseSeq;
+      if (!segment->map(false, 0)) {
+         setError(path.string() + ": " + std::strerror(errno));
+         segments.clear();
+         return false;
+      }
+
+      std::size_t offset = 0;
+      std::size_t count = 0;
+      std::uint64_t seq = 0;
+      while (std::size_t size = segment->data ? recordAt(segment->data, segment->size, offset, seq) : 0) {
+         if (seq != expected) break;
+         if (count % options.indexInterval == 0) segment->index.push_back({ seq, offset });
+         offset += size;
+         count++;
+         expected++;
+      }
+      // A torn tail would otherwise be read as garbage after the next append.
+      if (offset + 4 <= segment->size && load<std::uint32_t>(segment->data + offset) != 0) {
+         std::memset(segment->data + offset, 0, segment->size - offset);
+         broken = true;
+      }
+      segment->end = offset;
+      segment->synced = offset;
+
+      if (count == 0) {
+         std::filesystem::remove(path, fsError);
+         continue;
+      }
+      sinceIndexed = count;
+      segments.push_back(std::move(segment));
+   }
+
+   nextSeq = expected;
+   writtenSeq = expected - 1;
+   durableSeq = expected - 1;
+   return true;
+}
+
+void FrameLog::close() {
+   if (!writer.joinable()) return;
+   {
+      std::lock_guard<std::mutex> lock(queueMutex);
+      stopping = true;
+   }
+   queueCv.notify_all();
+   writer.join();
+   opened = false;
+   syncedCv.notify_all();
+
+   std::lock_guard<std::mutex> lock(segmentsMutex);
+   segments.clear();
+}
+
+bool FrameLog::isOpen() const {
+   return opened;
+}
+
+std::string FrameLog::getError() const {
+   std::lock_guard<std::mutex> lock(errorMutex);
+   return error;
+}
+
+void FrameLog::setErrorHandler(ErrorHandler handler) {
+   errorHandler = std::move(handler);
+}
+
+void FrameLog::setError(std::string message) {
+   std::lock_guard<std::mutex> lock(errorMutex);
+   error = std::move(message);
+}
+
+void FrameLog::fail(std::string message) {
+   opened = false;
+   setError(message);
+   if (errorHandler) errorHandler(message);
+}
+
+std::uint64_t FrameLog::append(std::string_view key, SharedBuffer frame) {
+   if (!opened || key.size() > maxKeySize) return 0;
+   if (headerSize + key.size() + frame->size() > options.segmentSize) return 0;
+
+   std::lock_guard<std::mutex> lock(queueMutex);
+   if (stopping) return 0;
+   std::uint64_t seq = nextSeq++;
+   queue.push_back({ seq, std::string(key), std::move(frame) });
+   queueCv.notify_one();
+   return seq;
+}
+
+void FrameLog::flush() {
+   std::unique_lock<std::mutex> lock(queueMutex);
+   std::uint64_t target = nextSeq - 1;
+   syncRequested = true;
+   queueCv.notify_one();
+   syncedCv.wait(lock, [&]() { return durableSeq >= target || !opened; });
+}
+
+std::uint64_t FrameLog::read(std::uint64_t since, const Visitor& visitor) const {
+   return read(since, std::numeric_limits<std::uint64_t>::max(), visitor);
+}
+
+std::uint64_t FrameLog::read(std::uint64_t since, std::uint64_t until, const Visitor& visitor) const {
+   std::vector<std::shared_ptr<Segment>> list;
+   std::size_t offset = 0;
+   {
+      std::lock_guard<std::mutex> lock(segmentsMutex);
+      auto it = std::upper_bound(segments.begin(), segments.end(), since + 1, [](std::uint64_t seq, const std::shared_ptr<Segment>& segment) {
+         return seq < segment->baseSeq;
+      });
+      if (it != segments.begin()) --it;
+      if (it == segments.end()) return since;
+
+      auto& index = (*it)->index;
+      auto entry = std::upper_bound(index.begin(), index.end(), since + 1, [](std::uint64_t seq, const IndexEntry& indexed) {
+         return seq < indexed.seq;
+      });
+      if (entry != index.begin()) offset = std::prev(entry)->offset;
+      list.assign(it, segments.end());
+   }
+
+   std::uint64_t upTo = std::min(until, writtenSeq.load(std::memory_order_acquire));
+   std::uint64_t last = since;
+   for (auto& segment : list) {
+      std::size_t end = segment->end.load(std::memory_order_acquire);
+      while (offset < end) {
+         const ubyte_8* record = segment->data + offset;
+         std::size_t size = load<std::uint32_t>(record);
+         std::uint64_t seq = load<std::uint64_t>(record + 8);
+         if (seq > upTo) return last;
+         if (seq > since) {
+            std::size_t keySize = load<std::uint16_t>(record + 16);
+            std::string_view key(reinterpret_cast<const char*>(record + headerSize), keySize);
+            visitor(seq, key, std::span<const ubyte_8>(record + headerSize + keySize, size - headerSize - keySize));
+            last = seq;
+         }
+         offset += size;
+      }
+      offset = 0;
+   }
+   return last;
+}
+
+std::uint64_t FrameLog::firstSequence() const {
+   std::lock_guard<std::mutex> lock(segmentsMutex);
+   return segments.empty() ? 0 : segments.front()->baseSeq;
+}
+
+std::uint64_t FrameLog::lastSequence() const {
+   std::lock_guard<std::mutex> lock(queueMutex);
+   return nextSeq - 1;
+}
+
+std::uint64_t FrameLog::writtenSequence() const {
+   return writtenSeq.load(std::memory_order_acquire);
+}
+
+std::uint64_t FrameLog::durableSequence() const {
+   return durableSeq.load(std::memory_order_acquire);
+}
+
+std::shared_ptr<FrameLog::Segment> FrameLog::createSegment(std::uint64_t baseSeq) {
+   auto segment = std::make_shared<Segment>();
+   segment->path = dir / segmentName(baseSeq);
+   segment->baseSeq = baseSeq;
+   if (!segment->map(true, options.segmentSize)) return nullptr;
+   syncDirectory(dir);
+   return segment;
+}
+
+bool FrameLog::write(const Pending& pending) {
+   std::size_t size = headerSize + pending.key.size() + pending.frame->size();
+   Segment* segment = segments.empty() ? nullptr : segments.back().get();
+   if (!segment || segment->end.load(std::memory_order_relaxed) + size > segment->size) {
+      // A full segment is synced before the next one takes writes.
+      if (segment && !segment->sync(segment->end.load(std::memory_order_relaxed))) return false;
+      auto next = createSegment(pending.seq);
+      if (!next) return false;
+      segment = next.get();
+
+      std::lock_guard<std::mutex> lock(segmentsMutex);
+      segments.push_back(std::move(next));
+      while (options.maxSegments != 0 && segments.size() > options.maxSegments) {
+         // Readers still walking it keep the mapping alive.
+         std::error_code fsError;
+         std::filesystem::remove(segments.front()->path, fsError);
+         segments.erase(segments.begin());
+      }
+      sinceIndexed = 0;
+   }
+
+   std::size_t offset = segment->end.load(std::memory_order_relaxed);
+   ubyte_8* record = segment->data + offset;
+   store<std::uint64_t>(record + 8, pending.seq);
+   store<std::uint16_t>(record + 16, static_cast<std::uint16_t>(pending.key.size()));
+   std::memcpy(record + headerSize, pending.key.data(), pending.key.size());
+   std::memcpy(record + headerSize + pending.key.size(), pending.frame->data(), pending.frame->size());
+   store<std::uint32_t>(record + 4, checksum(record + 8, size - 8));
+   store<std::uint32_t>(record, static_cast<std::uint32_t>(size));
+
+   if (sinceIndexed++ % options.indexInterval == 0) {
+      std::lock_guard<std::mutex> lock(segmentsMutex);
+      segment->index.push_back({ pending.seq, offset });
+   }
+   segment->end.store(offset + size, std::memory_order_release);
+   return true;
+}
+
+void FrameLog::sync() {
+   // Only the newest segment can have unsynced records, write() syncs the others on roll.
+   bool synced = true;
+   if (!segments.empty()) {
+      Segment& segment = *segments.back();
+      synced = segment.sync(segment.end.load(std::memory_order_relaxed));
+      if (!synced) fail("sync " + segment.path.string() + ": " + std::strerror(errno));
+   }
+   lastSync = std::chrono::steady_clock::now();
+   {
+      std::lock_guard<std::mutex> lock(queueMutex);
+      if (synced) durableSeq.store(writtenSeq.load(std::memory_order_relaxed), std::memory_order_release);
+   }
+   syncedCv.notify_all();
+}
+
+void FrameLog::writerLoop() {
+   std::vector<Pending> batch;
+   std::unique_lock<std::mutex> lock(queueMutex);
+   while (true) {
+      bool dirty = durableSeq.load(std::memory_order_relaxed) < writtenSeq.load(std::memory_order_relaxed);
+      if (queue.empty() && !stopping && !syncRequested) {
+         if (dirty) queueCv.wait_until(lock, lastSync + options.syncInterval);
+         else queueCv.wait(lock);
+      }
+      batch.swap(queue);
+      bool stop = stopping;
+      bool syncNow = syncRequested;
+      syncRequested = false;
+      lock.unlock();
+
+      for (auto& pending : batch) {
+         if (!opened) break;
+         if (!write(pending)) {
+            // Skipping the record would leave a gap, later appends are refused instead.
+            fail("write " + dir.string() + ": " + std::strerror(errno));
+            break;
+         }
+         writtenSeq.store(pending.seq, std::memory_order_release);
+      }
+      batch.clear();
+
+      if (durableSeq.load(std::memory_order_relaxed) < writtenSeq.load(std::memory_order_relaxed)
+         && (stop || syncNow || std::chrono::steady_clock::now() - lastSync >= options.syncInterval)) {
+         sync();
+      } else if (syncNow) {
+         syncedCv.notify_all();
+      }
+
+      lock.lock();
+      if (stop && queue.empty()) break;
+   }
+}
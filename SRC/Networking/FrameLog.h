@@ -0,0 +1,127 @@
+#ifndef NETWORK_FRAME_LOG_H
+#define NETWORK_FRAME_LOG_H
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "BufferPool.h"
+
+namespace SN {
+   // Durable, append-only log of keyed frames, numbered from 1. Records go to fixed-size,
+   // memory-mapped segment files named after their first sequence number. Appends only
+   // queue the frame; a writer thread copies batches into the mapping and syncs them at
+   // most syncInterval apart, so one sync commits every append of that window. Reads walk
+   // the mappings, i.e. the page cache, starting at a sparse sequence -> offset index.
+   // POSIX only, open() fails on Windows.
+   class FrameLog {
+   public:
+      struct Options {
+         std::size_t segmentSize = 16 * 1024 * 1024;
+         // Records between two index entries.
+         std::size_t indexInterval = 64;
+         // 0 syncs after every written batch.
+         std::chrono::milliseconds syncInterval{ 100 };
+         // Oldest segments are deleted beyond this many, 0 keeps all of them.
+         std::size_t maxSegments = 0;
+      };
+
+      // Visits one record, the spans point into the mapping and are only valid inside the call.
+      using Visitor = std::function<void(std::uint64_t seq, std::string_view key, std::span<const ubyte_8> frame)>;
+      // Called on the writer thread when a write or sync failed, the log is closed for appends by then.
+      using ErrorHandler = std::function<void(const std::string& error)>;
+
+      FrameLog() = default;
+      ~FrameLog();
+
+      FrameLog(const FrameLog&) = delete;
+      FrameLog& operator=(const FrameLog&) = delete;
+
+      // Recovers the segments in dir, creating it if needed, and starts the writer.
+      // A torn record at the end of the log, from a crash mid write, is dropped.
+      bool open(const std::filesystem::path& dir);
+      bool open(const std::filesystem::path& dir, Options options);
+      // Writes and syncs everything appended so far, then stops the writer.
+      void close();
+      bool isOpen() const;
+      // The last failure of open, a write or a sync.
+      std::string getError() const;
+      // Set it before open().
+      void setErrorHandler(ErrorHandler handler);
+
+      // The sequence number frame will be written with, 0 if the log is closed or the
+      // record does not fit a segment. Never waits for disk.
+      std::uint64_t append(std::string_view key, SharedBuffer frame);
+      // Blocks until everything appended before the call is synced.
+      void flush();
+
+      // Visits the written records numbered above since in order, returns the last one visited, since if none.
+      std::uint64_t read(std::uint64_t since, const Visitor& visitor) const;
+      // Stops after the record numbered until.
+      std::uint64_t read(std::uint64_t since, std::uint64_t until, const Visitor& visitor) const;
+
+      // The oldest record still kept, 0 for an empty log.
+      std::uint64_t firstSequence() const;
+      // Last appended, written to the mappings and synced to disk.
+      std::uint64_t lastSequence() const;
+      std::uint64_t writtenSequence() const;
+      std::uint64_t durableSequence() const;
+
+   private:
+      struct Segment;
+      struct IndexEntry {
+         std::uint64_t seq;
+         std::size_t offset;
+      };
+      struct Pending {
+         std::uint64_t seq;
+         std::string key;
+         SharedBuffer frame;
+      };
+
+      void setError(std::string message);
+      // Closes the log for appends and reports message.
+      void fail(std::string message);
+      bool recover();
+      std::shared_ptr<Segment> createSegment(std::uint64_t baseSeq);
+      bool write(const Pending& record);
+      void sync();
+      void writerLoop();
+
+      std::filesystem::path dir;
+      Options options;
+      mutable std::mutex errorMutex;
+      std::string error;
+      ErrorHandler errorHandler;
+
+      // Segment list and their indexes, read under it, changed by the writer.
+      mutable std::mutex segmentsMutex;
+      std::vector<std::shared_ptr<Segment>> segments;
+
+      mutable std::mutex queueMutex;
+      std::condition_variable queueCv;
+      std::condition_variable syncedCv;
+      std::vector<Pending> queue;
+      std::uint64_t nextSeq = 1;
+      bool stopping = false;
+      bool syncRequested = false;
+
+      std::atomic<bool> opened = false;
+      std::atomic<std::uint64_t> writtenSeq = 0;
+      std::atomic<std::uint64_t> durableSeq = 0;
+      std::size_t sinceIndexed = 0;
+      std::chrono::steady_clock::time_point lastSync;
+      std::thread writer;
+   };
+}
+
+#endif //NETWORK_FRAME_LOG_H
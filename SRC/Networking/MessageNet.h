@@ -0,0 +1,202 @@
+#ifndef NETWORK_MESSAGE_NET_H
+#define NETWORK_MESSAGE_NET_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+#include "PacketNet.h"
+
+namespace PN {
+   // Binds a SERIALIZABLE message type to the numeric id it is sent with.
+   template<std::uint32_t Id, SerializableType M>
+   struct MessageType {
+      constexpr static std::uint32_t id = Id;
+      using type = M;
+   };
+
+   // No-op handler of one message type, MessageNetClient/Connection subclasses override the ones they need.
+   template<typename M>
+   class MessageHandler {
+   public:
+      virtual ~MessageHandler() = default;
+
+   protected:
+      virtual void onMessage(const M& msg) {}
+   };
+
+   // Registered messages travel as a packet payload of a varint id followed by the message
+   // fields. The ids index a dense jump table, so keep them small.
+   template<typename... Entries>
+   struct MessageRegistry {
+      static_assert(sizeof...(Entries) > 0, "MessageRegistry needs at least one MessageType");
+
+      constexpr static std::uint32_t maxId = std::max({ Entries::id... });
+      static_assert(maxId < 4096, "message ids index a dense table, keep them below 4096");
+
+      template<typename M>
+      constexpr static bool contains = (std::is_same_v<M, typename Entries::type> || ...);
+
+      template<typename M> requires contains<M>
+      constexpr static std::uint32_t idOf() {
+         std::uint32_t id = 0;
+         ((std::is_same_v<M, typename Entries::type> ? (id = Entries::id, true) : false) || ...);
+         return id;
+      }
+
+      // One overridable onMessage per registered type.
+      class Handlers : public MessageHandler<typename Entries::type>... {
+      protected:
+         using MessageHandler<typename Entries::type>::onMessage...;
+      };
+
+      // msg prefixed with its id, so it can go through sendPacket(const M&) and frameMessage.
+      template<SerializableType M> requires contains<M>
+      struct Tagged : Serializable {
+         const M& msg;
+
+         explicit Tagged(const M& message) : msg(message) {}
+
+         std::vector<ubyte_8> serialize() const override {
+            std::vector<ubyte_8> buf;
+            buf.reserve(serializedSize());
+            serializeInto(buf);
+            return buf;
+         }
+
+         void serializeInto(std::vector<ubyte_8>& buf) const override {
+            writeVarint(buf, idOf<M>());
+            msg.serializeInto(buf);
+         }
+
+         std::size_t serializedSize() const override {
+            return varintSize(idOf<M>()) + msg.serializedSize();
+         }
+
+         // Send only, received messages are decoded by dispatch.
+         bool deserialize(std::span<const ubyte_8>, size_t&) override {
+            return false;
+         }
+      };
+
+      // Packet payload of msg, e.g. for PacketNetServer::broadcast.
+      template<SerializableType M> requires contains<M>
+      static std::vector<ubyte_8> encode(const M& msg) {
+         return Tagged<M>(msg).serialize();
+      }
+
+      // Decodes the message with the given id from buf at offset into a stack object and
+      // calls handler with it. False for unregistered ids and messages that fail to decode.
+      template<typename Handler>
+      static bool dispatch(ulong_64 id, std::span<const ubyte_8> buf, ulong_64 offset, Handler&& handler) {
+         using H = std::remove_reference_t<Handler>;
+         constexpr static std::array<bool (*)(std::span<const ubyte_8>, ulong_64, H&), maxId + 1> table = makeTable<H>();
+         if(id > maxId || table[id] == nullptr) return false;
+         return table[id](buf, offset, handler);
+      }
+
+   private:
+      template<typename Entry, typename H>
+      static bool decode(std::span<const ubyte_8> buf, ulong_64 offset, H& handler) {
+         typename Entry::type msg;
+         if(!msg.deserialize(buf, offset)) return false;
+         handler(std::as_const(msg));
+         return true;
+      }
+
+      template<typename H>
+      constexpr static auto makeTable() {
+         std::array<bool (*)(std::span<const ubyte_8>, ulong_64, H&), maxId + 1> table{};
+         ((table[Entries::id] = &decode<Entries, H>), ...);
+         return table;
+      }
+   };
+
+   // Typed messages over a PacketNetClient or PacketNetConnection: every packet after the
+   // handshake is decoded by Registry and passed to the matching onMessage overload.
+   template<typename Base, typename Registry>
+   class MessageNetEndpoint : public Base, public Registry::Handlers {
+   public:
+      using Base::Base;
+
+      template<SerializableType M> requires (Registry::template contains<M> && FrameWritable<typename Base::HandshakeType> && FrameWritable<typename Base::PacketType>)
+      void sendMessage(const M& msg) {
+         // The first packet would otherwise be taken as the handshake.
+         if(this->firstSend) this->sendHandshake();
+         this->sendPacket(typename Registry::template Tagged<M>(msg));
+      }
+
+      // Coroutine counterparts, see PacketNetEndpoint::readPacket.
+      template<SerializableType M> requires (Registry::template contains<M> && FrameWritable<typename Base::HandshakeType> && FrameWritable<typename Base::PacketType>)
+      asio::awaitable<bool> writeMessage(const M& msg) {
+         if(this->firstSend) {
+            bool written = co_await this->writeHandshake(typename Base::PacketType());
+            if(!written) co_return false;
+         }
+         co_return co_await this->writePacket(typename Registry::template Tagged<M>(msg));
+      }
+
+      // Awaits the next M. Other messages arriving before it go to their onMessage overloads.
+      template<SerializableType M> requires Registry::template contains<M>
+      asio::awaitable<std::optional<M>> readMessage() {
+         while (true) {
+            std::optional<typename Base::PacketType> pkt = co_await this->readPacket();
+            if(!pkt) co_return std::nullopt;
+
+            ulong_64 offset = 0;
+            ulong_64 id = 0;
+            if(readVarint(pkt->data, offset, id) && id == Registry::template idOf<M>()) {
+               M msg;
+               if(msg.deserialize(pkt->data, offset)) co_return msg;
+               onUnknownMessage(id, pkt->data);
+               continue;
+            }
+            dispatchMessage(pkt->data);
+         }
+      }
+
+   protected:
+      void onPacket(const typename Base::PacketType& pkt) override {
+         dispatchMessage(pkt.data);
+      }
+
+      void onPacketView(const PacketView& pkt) override {
+         dispatchMessage(pkt.data);
+      }
+
+      void onPackets(std::span<const PacketView> pkts) override {
+         for (auto& pkt : pkts) onPacketView(pkt);
+      }
+
+      // Unregistered ids and payloads that don't decode as their message end up here.
+      virtual void onUnknownMessage(ulong_64 id, std::span<const ubyte_8> payload) {}
+
+   private:
+      void dispatchMessage(std::span<const ubyte_8> payload) {
+         ulong_64 offset = 0;
+         ulong_64 id = 0;
+         if(readVarint(payload, offset, id) && Registry::dispatch(id, payload, offset, [this](const auto& msg) { this->onMessage(msg); })) return;
+         onUnknownMessage(id, payload);
+      }
+   };
+
+
+   template <typename Registry, FrameCodec T = DefaultPacket, FrameCodec U = T>
+   class MessageNetClient : public MessageNetEndpoint<PacketNetClient<T, U>, Registry> {
+   public:
+      using MessageNetEndpoint<PacketNetClient<T, U>, Registry>::MessageNetEndpoint;
+   };
+
+
+   template <typename Registry, FrameCodec T = DefaultPacket, FrameCodec U = T>
+   class MessageNetConnection : public MessageNetEndpoint<PacketNetConnection<T, U>, Registry> {
+   public:
+      using MessageNetEndpoint<PacketNetConnection<T, U>, Registry>::MessageNetEndpoint;
+   };
+}
+
+#endif // NETWORK_MESSAGE_NET_H
@@ -0,0 +1,178 @@
+#ifndef NETWORK_NET_METRICS_H
+#define NETWORK_NET_METRICS_H
+#include <array>
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace SN {
+   // Lock-free histogram over power of two buckets: bucket i counts values up to 2^i - 1.
+   class Histogram {
+   public:
+      constexpr static std::size_t bucketCount = 40;
+
+      struct Snapshot {
+         std::array<std::uint64_t, bucketCount> buckets{};
+         std::uint64_t count = 0;
+         std::uint64_t sum = 0;
+
+         // Upper bound of the bucket holding the given quantile (0..1).
+         std::uint64_t percentile(double quantile) const {
+            if (count == 0) return 0;
+            std::uint64_t target = static_cast<std::uint64_t>(quantile * static_cast<double>(count));
+            std::uint64_t seen = 0;
+            for (std::size_t i = 0; i < bucketCount; i++) {
+               seen += buckets[i];
+               if (seen > target) return upperBound(i);
+            }
+            return upperBound(bucketCount - 1);
+         }
+      };
+
+      void record(std::uint64_t value) {
+         std::size_t bucket = std::min<std::size_t>(std::bit_width(value), bucketCount - 1);
+         buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+         count.fetch_add(1, std::memory_order_relaxed);
+         sum.fetch_add(value, std::memory_order_relaxed);
+      }
+
+      Snapshot snapshot() const {
+         Snapshot snap;
+         for (std::size_t i = 0; i < bucketCount; i++) snap.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+         snap.count = count.load(std::memory_order_relaxed);
+         snap.sum = sum.load(std::memory_order_relaxed);
+         return snap;
+      }
+
+      static std::uint64_t upperBound(std::size_t bucket) {
+         return (std::uint64_t(1) << bucket) - 1;
+      }
+
+   private:
+      std::array<std::atomic<std::uint64_t>, bucketCount> buckets{};
+      std::atomic<std::uint64_t> count{0};
+      std::atomic<std::uint64_t> sum{0};
+   };
+
+   struct TrafficCounters {
+      struct Snapshot {
+         std::uint64_t bytesIn = 0;
+         std::uint64_t bytesOut = 0;
+         std::uint64_t packetsIn = 0;
+         std::uint64_t packetsOut = 0;
+      };
+
+      std::atomic<std::uint64_t> bytesIn{0};
+      std::atomic<std::uint64_t> bytesOut{0};
+      std::atomic<std::uint64_t> packetsIn{0};
+      std::atomic<std::uint64_t> packetsOut{0};
+
+      Snapshot snapshot() const {
+         return { bytesIn.load(std::memory_order_relaxed), bytesOut.load(std::memory_order_relaxed),
+            packetsIn.load(std::memory_order_relaxed), packetsOut.load(std::memory_order_relaxed) };
+      }
+   };
+
+   // Counters are indexed by the owner's Error enum.
+   struct ErrorCounters {
+      constexpr static std::size_t maxErrors = 16;
+      std::array<std::atomic<std::uint64_t>, maxErrors> counts{};
+
+      void add(std::size_t err) {
+         if (err < maxErrors) counts[err].fetch_add(1, std::memory_order_relaxed);
+      }
+
+      std::array<std::uint64_t, maxErrors> snapshot() const {
+         std::array<std::uint64_t, maxErrors> snap{};
+         for (std::size_t i = 0; i < maxErrors; i++) snap[i] = counts[i].load(std::memory_order_relaxed);
+         return snap;
+      }
+   };
+
+   struct NetMetrics {
+      struct Snapshot {
+         std::uint64_t accepted = 0;
+         std::uint64_t active = 0;
+         TrafficCounters::Snapshot traffic;
+         Histogram::Snapshot readSize;
+         Histogram::Snapshot writeQueueDepth;
+         Histogram::Snapshot decodeTime;
+         Histogram::Snapshot handlerTime;
+         std::array<std::uint64_t, ErrorCounters::maxErrors> errors{};
+      };
+
+      std::atomic<std::uint64_t> accepted{0};
+      std::atomic<std::int64_t> active{0};
+      TrafficCounters traffic;
+      Histogram readSize;
+      Histogram writeQueueDepth;
+      Histogram decodeTime;
+      Histogram handlerTime;
+      ErrorCounters errors;
+
+      Snapshot snapshot() const {
+         Snapshot snap;
+         snap.accepted = accepted.load(std::memory_order_relaxed);
+         snap.active = static_cast<std::uint64_t>(std::max<std::int64_t>(active.load(std::memory_order_relaxed), 0));
+         snap.traffic = traffic.snapshot();
+         snap.readSize = readSize.snapshot();
+         snap.writeQueueDepth = writeQueueDepth.snapshot();
+         snap.decodeTime = decodeTime.snapshot();
+         snap.handlerTime = handlerTime.snapshot();
+         snap.errors = errors.snapshot();
+         return snap;
+      }
+
+      // Prometheus text exposition of the snapshot, errors are labelled with errorNames.
+      static void appendPrometheus(std::string& out, std::string_view prefix, const Snapshot& snap, std::span<const std::string_view> errorNames) {
+         appendValue(out, prefix, "accepted_connections_total", "counter", snap.accepted);
+         appendValue(out, prefix, "active_connections", "gauge", snap.active);
+         appendValue(out, prefix, "bytes_in_total", "counter", snap.traffic.bytesIn);
+         appendValue(out, prefix, "bytes_out_total", "counter", snap.traffic.bytesOut);
+         appendValue(out, prefix, "packets_in_total", "counter", snap.traffic.packetsIn);
+         appendValue(out, prefix, "packets_out_total", "counter", snap.traffic.packetsOut);
+         appendHistogram(out, prefix, "read_size_bytes", snap.readSize);
+         appendHistogram(out, prefix, "write_queue_depth", snap.writeQueueDepth);
+         appendHistogram(out, prefix, "decode_time_ns", snap.decodeTime);
+         appendHistogram(out, prefix, "handler_time_ns", snap.handlerTime);
+         appendErrors(out, prefix, "errors_total", snap.errors, errorNames);
+      }
+
+      static void appendValue(std::string& out, std::string_view prefix, std::string_view name, std::string_view type, std::uint64_t value) {
+         out.append("# TYPE ").append(prefix).append(name).append(" ").append(type).append("\n");
+         out.append(prefix).append(name).append(" ").append(std::to_string(value)).append("\n");
+      }
+
+      static void appendHistogram(std::string& out, std::string_view prefix, std::string_view name, const Histogram::Snapshot& snap) {
+         out.append("# TYPE ").append(prefix).append(name).append(" histogram\n");
+         std::uint64_t cumulative = 0;
+         std::size_t last = 0;
+         for (std::size_t i = 0; i < Histogram::bucketCount; i++) {
+            if (snap.buckets[i]) last = i;
+         }
+         for (std::size_t i = 0; i <= last; i++) {
+            cumulative += snap.buckets[i];
+            out.append(prefix).append(name).append("_bucket{le=\"").append(std::to_string(Histogram::upperBound(i)))
+               .append("\"} ").append(std::to_string(cumulative)).append("\n");
+         }
+         out.append(prefix).append(name).append("_bucket{le=\"+Inf\"} ").append(std::to_string(snap.count)).append("\n");
+         out.append(prefix).append(name).append("_sum ").append(std::to_string(snap.sum)).append("\n");
+         out.append(prefix).append(name).append("_count ").append(std::to_string(snap.count)).append("\n");
+      }
+
+      static void appendErrors(std::string& out, std::string_view prefix, std::string_view name,
+         const std::array<std::uint64_t, ErrorCounters::maxErrors>& errors, std::span<const std::string_view> errorNames) {
+         out.append("# TYPE ").append(prefix).append(name).append(" counter\n");
+         for (std::size_t i = 0; i < errorNames.size() && i < ErrorCounters::maxErrors; i++) {
+            out.append(prefix).append(name).append("{error=\"").append(errorNames[i]).append("\"} ")
+               .append(std::to_string(errors[i])).append("\n");
+         }
+      }
+   };
+}
+
+#endif //NETWORK_NET_METRICS_H
@@ -1,16 +1,104 @@
 #ifndef NETWORK_PACKET_NET_TEMPLATED_H
 #define NETWORK_PACKET_NET_TEMPLATED_H
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <concepts>
+#include <cstddef>
 #include <type_traits>
 #include <vector>
 #include <cstring>
+#include <deque>
+#include <limits>
+#include <list>
 #include <map>
-
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <tuple>
+#include <unordered_map>
+
+#include "FrameHistory.h"
+#include "FrameLog.h"
+#include "RoomIndex.h"
 #include "StreamedNet.h"
 
-#define SERIALIZABLE(...) \
-   std::vector<ubyte_8> serialize() const override { std::vector<ubyte_8> buf; PN::serializeFields(buf, __VA_ARGS__);  return buf; } \
-   bool deserialize(const std::vector<ubyte_8>& buf, size_t& offset) override { return PN::deserializeFields(buf, offset, __VA_ARGS__); }
+#define PN_SERIALIZABLE_ENCODING PN::encodingOf<std::remove_cvref_t<decltype(*this)>>()
+
+// M(field) for every field, comma separated, up to 32 of them.
+#define PN_EXPAND(x) x
+#define PN_FOR_EACH_1(M, x) M(x)
+#define PN_FOR_EACH_2(M, x, ...) M(x), PN_EXPAND(PN_FOR_EACH_1(M, __VA_ARGS__))
+#define PN_FOR_EACH_3(M, x, ...) M(x), PN_EXPAND(PN_FOR_EACH_2(M, __VA_ARGS__))
+#define PN_FOR_EACH_4(M, x, ...) M(x), PN_EXPAND(PN_FOR_EACH_3(M, __VA_ARGS__))
+#define PN_FOR_EACH_5(M, x, ...) M(x), PN_EXPAND(PN_FOR_EACH_4(M, __VA_ARGS__))
+#define PN_FOR_EACH_6(M, x, ...) M(x), PN_EXPAND(PN_FOR_EACH_5(M, __VA_ARGS__))
+#define PN_FOR_EACH_7(M, x, ...) M(x), PN_EXPAND(PN_FOR_EACH_6(M, __VA_ARGS__))
+#define PN_FOR_EACH_8(M, x, ...) M(x), PN_EXPAND(PN_FOR_EACH_7(M, __VA_ARGS__))
+#define PN_FOR_EACH_9(M, x, ...) M(x), PN_EXPAND(PN_FOR_EACH_8(M, __VA_ARGS__))
+#define PN_FOR_EACH_10(M, x, ...) M(x), PN_EXPAND(PN_FOR_EACH_9(M, __VA_ARGS__))
+#define PN_FOR_EACH_11(M, x, ...) M(x), PN_EXPAND(PN_FOR_EACH_10(M, __VA_ARGS__))
+#define PN_FOR_EACH_12(M, x, ...) M(x), PN_EXPAND(PN_FOR_EACH_11(M, __VA_ARGS__))
+#define PN_FOR_EACH_13(M, x, ...) M(x), PN_EXPAND(PN_FOR_EACH_12(M, __VA_ARGS__))
+#define PN_FOR_EACH_14(M, x, ...) M(x), PN_EXPAND(PN_FOR_EACH_13(M, __VA_ARGS__))
+#define PN_FOR_EACH_15(M, x, ...) M(x), PN_EXPAND(PN_FOR_EACH_14(M, __VA_ARGS__))
+#define PN_FOR_EACH_16(M, x, ...) M(x), PN_EXPAND(PN_FOR_EACH_15(M, __VA_ARGS__))
+#define PN_FOR_EACH_17(M, x, ...) M(x), PN_EXPAND(PN_FOR_EACH_16(M, __VA_ARGS__))
+#define PN_FOR_EACH_18(M, x, ...) M(x), PN_EXPAND(PN_FOR_EACH_17(M, __VA_ARGS__))
+#define PN_FOR_EACH_19(M, x, ...) M(x), PN_EXPAND(PN_FOR_EACH_18(M, __VA_ARGS__))
+#define PN_FOR_EACH_20(M, x, ...) M(x), PN_EXPAND(PN_FOR_EACH_19(M, __VA_ARGS__))
+#define PN_FOR_EACH_21(M, x, ...) M(x), PN_EXPAND(PN_FOR_EACH_20(M, __VA_ARGS__))
+#define PN_FOR_EACH_22(M, x, ...) M(x), PN_EXPAND(PN_FOR_EACH_21(M, __VA_ARGS__))
+#define PN_FOR_EACH_23(M, x, ...) M(x), PN_EXPAND(PN_FOR_EACH_22(M, __VA_ARGS__))
+#define PN_FOR_EACH_24(M, x, ...) M(x), PN_EXPAND(PN_FOR_EACH_23(M, __VA_ARGS__))
+#define PN_FOR_EACH_25(M, x, ...) M(x), PN_EXPAND(PN_FOR_EACH_24(M, __VA_ARGS__))
+#define PN_FOR_EACH_26(M, x, ...) M(x), PN_EXPAND(PN_FOR_EACH_25(M, __VA_ARGS__))
+#define PN_FOR_EACH_27(M, x, ...) M(x), PN_EXPAND(PN_FOR_EACH_26(M, __VA_ARGS__))
+#define PN_FOR_EACH_28(M, x, ...) M(x), PN_EXPAND(PN_FOR_EACH_27(M, __VA_ARGS__))
+#define PN_FOR_EACH_29(M, x, ...) M(x), PN_EXPAND(PN_FOR_EACH_28(M, __VA_ARGS__))
+#define PN_FOR_EACH_30(M, x, ...) M(x), PN_EXPAND(PN_FOR_EACH_29(M, __VA_ARGS__))
+#define PN_FOR_EACH_31(M, x, ...) M(x), PN_EXPAND(PN_FOR_EACH_30(M, __VA_ARGS__))
+#define PN_FOR_EACH_32(M, x, ...) M(x), PN_EXPAND(PN_FOR_EACH_31(M, __VA_ARGS__))
+#define PN_FOR_EACH_PICK(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, _17, _18, _19, _20, _21, _22, _23, _24, _25, _26, _27, _28, _29, _30, _31, _32, NAME, ...) NAME
+#define PN_FOR_EACH(M, ...) PN_EXPAND(PN_FOR_EACH_PICK(__VA_ARGS__, PN_FOR_EACH_32, PN_FOR_EACH_31, PN_FOR_EACH_30, PN_FOR_EACH_29, PN_FOR_EACH_28, PN_FOR_EACH_27, PN_FOR_EACH_26, PN_FOR_EACH_25, PN_FOR_EACH_24, PN_FOR_EACH_23, PN_FOR_EACH_22, PN_FOR_EACH_21, PN_FOR_EACH_20, PN_FOR_EACH_19, PN_FOR_EACH_18, PN_FOR_EACH_17, PN_FOR_EACH_16, PN_FOR_EACH_15, PN_FOR_EACH_14, PN_FOR_EACH_13, PN_FOR_EACH_12, PN_FOR_EACH_11, PN_FOR_EACH_10, PN_FOR_EACH_9, PN_FOR_EACH_8, PN_FOR_EACH_7, PN_FOR_EACH_6, PN_FOR_EACH_5, PN_FOR_EACH_4, PN_FOR_EACH_3, PN_FOR_EACH_2, PN_FOR_EACH_1)(M, __VA_ARGS__))
+
+// offsetof is only conditionally supported for classes with virtual functions like
+// Serializable; every compiler the project builds with handles it without virtual bases.
+#if defined(__GNUC__)
+#define PN_OFFSETOF_BEGIN _Pragma("GCC diagnostic push") _Pragma("GCC diagnostic ignored \"-Winvalid-offsetof\"")
+#define PN_OFFSETOF_END _Pragma("GCC diagnostic pop")
+#else
+#define PN_OFFSETOF_BEGIN
+#define PN_OFFSETOF_END
+#endif
+
+#define PN_FIELD_OFFSET(field) offsetof(PNSelf, field)
+#define PN_FIELD_SIZE(field) sizeof(field)
+
+// Declares PNContiguous: true when the fields follow each other in memory, in the given
+// order and without padding. Only valid in member function bodies, the class has to be complete.
+#define PN_FIELDS_LAYOUT(...) \
+   using PNSelf = std::remove_cvref_t<decltype(*this)>; \
+   PN_OFFSETOF_BEGIN \
+   constexpr bool PNContiguous = PN::isContiguousLayout(std::array{ PN_FOR_EACH(PN_FIELD_OFFSET, __VA_ARGS__) }, std::array{ PN_FOR_EACH(PN_FIELD_SIZE, __VA_ARGS__) }); \
+   PN_OFFSETOF_END
+
+#define PN_SERIALIZABLE_BODY(packing, ...) \
+   std::vector<ubyte_8> serialize() const override { std::vector<ubyte_8> buf; buf.reserve(serializedSize()); serializeInto(buf); return buf; } \
+   void serializeInto(std::vector<ubyte_8>& buf) const override { PN_FIELDS_LAYOUT(__VA_ARGS__) PN::serializeFields<PN_SERIALIZABLE_ENCODING, packing, PNContiguous>(buf, __VA_ARGS__); } \
+   std::size_t serializedSize() const override { return PN::serializedSizeOf<PN_SERIALIZABLE_ENCODING>(__VA_ARGS__); } \
+   PN::ulong_64 layoutHash() const override { constexpr PN::ulong_64 hash = decltype(PN::fieldTypes(__VA_ARGS__))::template layoutHash<PN_SERIALIZABLE_ENCODING>(#__VA_ARGS__); return hash; } \
+   bool deserialize(std::span<const ubyte_8> buf, size_t& offset) override { PN_FIELDS_LAYOUT(__VA_ARGS__) return PN::deserializeFields<PN_SERIALIZABLE_ENCODING, packing, PNContiguous>(buf, offset, __VA_ARGS__); }
+
+// Takes up to 32 fields.
+#define SERIALIZABLE(...) PN_SERIALIZABLE_BODY(PN::Packing::Auto, __VA_ARGS__)
+// Like SERIALIZABLE, but fails to compile unless every field is trivially copyable and
+// fixed size, and the fields are laid out back to back in the given order.
+#define SERIALIZABLE_PACKED(...) PN_SERIALIZABLE_BODY(PN::Packing::Required, __VA_ARGS__)
 
 namespace PN {
    using namespace SN;
@@ -19,18 +107,53 @@ namespace PN {
    struct PacketNetPacket {
       PacketNetPacket() = default;
       virtual ~PacketNetPacket() = default;
-      virtual bool deserializeHead(std::vector<ubyte_8>& incoming) = 0;
+      virtual bool deserializeHead(const StreamBuffer& incoming) = 0;
       virtual bool checkHead() = 0;
       
-      virtual bool deserializeEnd(std::vector<ubyte_8>& incoming) = 0;
+      virtual bool deserializeEnd(const StreamBuffer& incoming) = 0;
       virtual bool checkEnd() = 0;
 
-      virtual std::vector<ubyte_8>& readData(std::vector<ubyte_8>& incoming) = 0;
-      virtual void erase(std::vector<ubyte_8>& incoming) = 0;
+      virtual std::vector<ubyte_8>& readData(const StreamBuffer& incoming) = 0;
+      virtual std::span<const ubyte_8> viewData(const StreamBuffer& incoming) const = 0;
+      virtual ulong_64 frameSize() const = 0;
+      virtual void erase(StreamBuffer& incoming) = 0;
 
       virtual std::vector<ubyte_8> serialize() const = 0;
    };
 
+   // Whether header + len + trailer bytes fit in maxSize, 0 meaning anything addressable.
+   // len comes off the wire, so it is compared against what is left instead of added to.
+   inline bool frameFits(ulong_64 header, ulong_64 len, ulong_64 trailer, ulong_64 maxSize) {
+      ulong_64 limit = maxSize != 0 ? maxSize : std::numeric_limits<std::size_t>::max();
+      return header <= limit && trailer <= limit - header && len <= limit - header - trailer;
+   }
+
+   // Non-owning view of one received frame, only valid inside the callback it is passed to.
+   struct PacketView {
+      std::span<const ubyte_8> data;
+      std::span<const ubyte_8> frame;
+
+      std::vector<ubyte_8> toVector() const {
+         return std::vector<ubyte_8>(data.begin(), data.end());
+      }
+
+      SharedBuffer shareFrame(BufferPool& pool = BufferPool::defaultPool()) const {
+         std::vector<ubyte_8> buf = pool.acquire(frame.size());
+         buf.assign(frame.begin(), frame.end());
+         return pool.share(std::move(buf));
+      }
+   };
+
+   // The frames of an onPackets batch copied into one shared buffer, e.g. to forward a
+   // whole read with a single broadcastFrame.
+   inline SharedBuffer shareFrames(std::span<const PacketView> pkts, BufferPool& pool = BufferPool::defaultPool()) {
+      std::size_t size = 0;
+      for (auto& pkt : pkts) size += pkt.frame.size();
+      std::vector<ubyte_8> buf = pool.acquire(size);
+      for (auto& pkt : pkts) buf.insert(buf.end(), pkt.frame.begin(), pkt.frame.end());
+      return pool.share(std::move(buf));
+   }
+
    struct DefaultPacket : PacketNetPacket {
       constexpr static const std::string_view headSpecifier = "PN_PACKET";
       constexpr static const std::string_view endSpecifier = "<~PN>";
@@ -47,28 +170,28 @@ namespace PN {
          len = data.size();
       }
 
-      ~DefaultPacket() override {}
+      ~DefaultPacket() override {
+         BufferPool::defaultPool().release(std::move(data));
+      }
 
-      bool deserializeHead(std::vector<ubyte_8>& incoming) override {
+      bool deserializeHead(const StreamBuffer& incoming) override {
          if(incoming.size() < headSpecifier.size() + 8) return false;
          
-         readHeadSpecifier = std::string_view(reinterpret_cast<char*>(incoming.data()), headSpecifier.size());
+         readHeadSpecifier = std::string_view(reinterpret_cast<const char*>(incoming.data()), headSpecifier.size());
          std::memcpy(&len, incoming.data()+headSpecifier.size(), 8);
 
          return true;
       }
 
       bool checkHead() override {
-         if(maxPacketSize != 0) {
-            if(headSpecifier.size() + 8 + len + endSpecifier.size() > maxPacketSize) return false;
-         }
+         if(!frameFits(headSpecifier.size() + 8, len, endSpecifier.size(), maxPacketSize)) return false;
          return readHeadSpecifier == headSpecifier;
       }
 
-      bool deserializeEnd(std::vector<ubyte_8>& incoming) override {
-         if(incoming.size() < headSpecifier.size() + 8 + len) return false;
+      bool deserializeEnd(const StreamBuffer& incoming) override {
+         if(incoming.size() < headSpecifier.size() + 8 + len + endSpecifier.size()) return false;
 
-         readEndSpecifier = std::string_view(reinterpret_cast<char*>(incoming.data() + headSpecifier.size() + 8 + len), endSpecifier.size());
+         readEndSpecifier = std::string_view(reinterpret_cast<const char*>(incoming.data() + headSpecifier.size() + 8 + len), endSpecifier.size());
          return true;
       }
 
@@ -76,31 +199,133 @@ namespace PN {
          return readEndSpecifier == endSpecifier;
       }
 
-      std::vector<ubyte_8>& readData(std::vector<ubyte_8>& incoming) override {
-         data = std::vector<ubyte_8>(incoming.begin() + headSpecifier.size() + 8, incoming.begin() + headSpecifier.size() + 8 + len);
+      std::vector<ubyte_8>& readData(const StreamBuffer& incoming) override {
+         if (data.capacity() < len) data = BufferPool::defaultPool().acquire(len);
+         data.assign(incoming.begin() + headSpecifier.size() + 8, incoming.begin() + headSpecifier.size() + 8 + len);
          return data;
       }
 
-      void erase(std::vector<ubyte_8>& incoming) override {
-         incoming.erase(incoming.begin(), incoming.begin() + headSpecifier.size() + 8 + len + endSpecifier.size());
+      std::span<const ubyte_8> viewData(const StreamBuffer& incoming) const override {
+         return { incoming.data() + headSpecifier.size() + 8, len };
+      }
+
+      ulong_64 frameSize() const override {
+         return headSpecifier.size() + 8 + len + endSpecifier.size();
+      }
+
+      void erase(StreamBuffer& incoming) override {
+         incoming.consume(frameSize());
       }
 
       std::vector<ubyte_8> serialize() const override {
-         std::vector<ubyte_8> buf(headSpecifier.size() + 8 + data.size() + endSpecifier.size());
+         std::vector<ubyte_8> buf = BufferPool::defaultPool().acquire(frameOverhead + data.size());
+         std::size_t start = beginFrame(buf);
+         buf.insert(buf.end(), data.begin(), data.end());
+         endFrame(buf, start);
+         return buf;
+      }
+
+      // Frame writing without a packet instance, the payload is appended between the two calls.
+      constexpr static std::size_t frameOverhead = headSpecifier.size() + 8 + endSpecifier.size();
+
+      static std::size_t beginFrame(std::vector<ubyte_8>& buf) {
+         std::size_t start = buf.size();
+         buf.insert(buf.end(), headSpecifier.begin(), headSpecifier.end());
+         buf.resize(buf.size() + 8);
+         return start;
+      }
+
+      static void endFrame(std::vector<ubyte_8>& buf, std::size_t start) {
+         ulong_64 payloadLen = buf.size() - start - headSpecifier.size() - 8;
+         std::memcpy(buf.data() + start + headSpecifier.size(), &payloadLen, 8);
+         buf.insert(buf.end(), endSpecifier.begin(), endSpecifier.end());
+      }
+   };
 
-         std::memcpy(buf.data(), headSpecifier.data(), headSpecifier.size());
-         std::memcpy(buf.data() + headSpecifier.size(), &len, 8);
-         std::memcpy(buf.data() + headSpecifier.size() + 8, data.data(), data.size());
-         std::memcpy(buf.data() + headSpecifier.size() + 8 + data.size(), endSpecifier.data(), endSpecifier.size());
+   // What PacketNetClient and PacketNetConnection need from a packet type. Packets are
+   // decoded through decodeFrame on the concrete type, so PacketNetPacket's virtuals are
+   // never dispatched and types don't need to derive from it at all.
+   template<typename P>
+   concept FrameCodec = std::default_initializable<P> && requires(P& pkt, const P& cpkt, StreamBuffer& incoming) {
+      { pkt.deserializeHead(incoming) } -> std::same_as<bool>;
+      { pkt.checkHead() } -> std::same_as<bool>;
+      { pkt.deserializeEnd(incoming) } -> std::same_as<bool>;
+      { pkt.checkEnd() } -> std::same_as<bool>;
+      { pkt.readData(incoming) } -> std::same_as<std::vector<ubyte_8>&>;
+      { cpkt.viewData(incoming) } -> std::convertible_to<std::span<const ubyte_8>>;
+      { cpkt.frameSize() } -> std::convertible_to<ulong_64>;
+      pkt.erase(incoming);
+      { cpkt.serialize() } -> std::same_as<std::vector<ubyte_8>>;
+   };
+
+   enum class FrameStatus {
+      Incomplete,
+      Complete,
+      Malformed
+   };
 
+   // Decodes the frame at the front of incoming into pkt. The qualified calls bind
+   // statically to P, which is always the exact type of a locally decoded packet.
+   template<FrameCodec P>
+   inline FrameStatus decodeFrame(P& pkt, const StreamBuffer& incoming) {
+      if(!pkt.P::deserializeHead(incoming)) return FrameStatus::Incomplete;
+      if(!pkt.P::checkHead()) return FrameStatus::Malformed;
+      if(!pkt.P::deserializeEnd(incoming)) return FrameStatus::Incomplete;
+      if(!pkt.P::checkEnd()) return FrameStatus::Malformed;
+      return FrameStatus::Complete;
+   }
+
+   template<typename P>
+   concept FrameWritable = requires(std::vector<ubyte_8>& buf) {
+      { P::frameOverhead } -> std::convertible_to<std::size_t>;
+      { P::beginFrame(buf) } -> std::convertible_to<std::size_t>;
+      P::endFrame(buf, std::size_t());
+   };
+
+   // Builds one outbound frame of packet type P in a pooled buffer: the payload is
+   // serialized straight behind the reserved header and finish() patches in its length.
+   template<FrameWritable P>
+   class FrameWriter {
+   public:
+      explicit FrameWriter(BufferPool& pool = BufferPool::defaultPool(), std::size_t payloadHint = 0) : buf(pool.acquire(payloadHint + P::frameOverhead)) {
+         start = P::beginFrame(buf);
+      }
+
+      // Sink for writeAny, serializeFields and Serializable::serializeInto.
+      std::vector<ubyte_8>& payload() {
          return buf;
       }
+
+      std::vector<ubyte_8> finish() {
+         P::endFrame(buf, start);
+         return std::move(buf);
+      }
+
+   private:
+      std::vector<ubyte_8> buf;
+      std::size_t start = 0;
    };
 
    struct Serializable {
       virtual std::vector<ubyte_8> serialize() const = 0;
-      virtual bool deserialize(const std::vector<ubyte_8>& buf, size_t& offset) = 0;
+      virtual bool deserialize(std::span<const ubyte_8> buf, size_t& offset) = 0;
       virtual ~Serializable() = default;
+
+      // Appends the encoding to buf, SERIALIZABLE writes the fields in place.
+      virtual void serializeInto(std::vector<ubyte_8>& buf) const {
+         std::vector<ubyte_8> tmp = serialize();
+         buf.insert(buf.end(), tmp.begin(), tmp.end());
+      }
+
+      // Exact size of serialize(), SERIALIZABLE computes it without encoding.
+      virtual std::size_t serializedSize() const {
+         return serialize().size();
+      }
+
+      // Hash of the field names, sizes and kinds, 0 when unknown.
+      virtual ulong_64 layoutHash() const {
+         return 0;
+      }
    };
 
    template<typename T>
@@ -112,293 +337,1487 @@ namespace PN {
    template <template<typename...> class Template, typename... Args>
    struct is_specialization<Template<Args...>, Template> : std::true_type {};
 
-   //<POD types>
+   template <typename T>
+   struct is_std_array : std::false_type {};
+
+   template <typename T, std::size_t N>
+   struct is_std_array<std::array<T, N>> : std::true_type {};
+
+   template <typename T>
+   struct is_span : std::false_type {};
+
+   template <typename T, std::size_t N>
+   struct is_span<std::span<T, N>> : std::true_type {};
+
+   // Wire encoding of a message type, picked up from a static wireEncoding member.
+   // Fixed writes lengths as 8 byte ulong_64, VarintLengths writes them as LEB128
+   // varints and Varint additionally writes integers as varints (zig-zag for signed).
+   enum class Encoding {
+      Fixed,
+      VarintLengths,
+      Varint
+   };
+
    template<typename T>
+   constexpr Encoding encodingOf() {
+      if constexpr (requires { T::wireEncoding; }) return T::wireEncoding;
+      else return Encoding::Fixed;
+   }
+
+   inline void writeVarint(std::vector<ubyte_8>& buf, ulong_64 v) {
+      while (v >= 0x80) {
+         buf.push_back(static_cast<ubyte_8>(v) | 0x80);
+         v >>= 7;
+      }
+      buf.push_back(static_cast<ubyte_8>(v));
+   }
+
+   inline bool readVarint(std::span<const ubyte_8> buf, ulong_64& offset, ulong_64& v) {
+      v = 0;
+      for (unsigned shift = 0; shift < 64; shift += 7) {
+         if (offset >= buf.size()) return false;
+         ubyte_8 byte = buf[offset++];
+         if (shift == 63 && byte > 1) return false;
+         v |= static_cast<ulong_64>(byte & 0x7F) << shift;
+         if (!(byte & 0x80)) return true;
+      }
+      return false;
+   }
+
+   inline ulong_64 zigZagEncode(std::int64_t v) {
+      return (static_cast<ulong_64>(v) << 1) ^ static_cast<ulong_64>(v >> 63);
+   }
+
+   inline std::int64_t zigZagDecode(ulong_64 v) {
+      return static_cast<std::int64_t>((v >> 1) ^ (~(v & 1) + 1));
+   }
+
+   template<Encoding E, typename T>
+   constexpr bool isVarintInteger = E == Encoding::Varint && std::is_integral_v<T> && !std::is_same_v<T, bool> && sizeof(T) > 1;
+
+   // Elements of contiguous containers that are copied with a single memcpy.
+   template<Encoding E, typename T>
+   constexpr bool isBulkElement = std::is_trivially_copyable_v<T> && !std::is_same_v<T, bool> && !isVarintInteger<E, T>;
+
+   // Arithmetic values are little endian on the wire, other trivially copyable types keep the host layout.
+   template<typename T>
+   constexpr bool needsByteSwap = std::endian::native != std::endian::little && std::is_arithmetic_v<T> && sizeof(T) > 1;
+
+   template<typename T>
+   inline void byteSwap(T& v) {
+      auto ptr = reinterpret_cast<ubyte_8*>(&v);
+      std::reverse(ptr, ptr + sizeof(T));
+   }
+
+   template<typename T>
+   inline void writeBulk(std::vector<ubyte_8>& buf, const T* data, std::size_t count) {
+      std::size_t start = buf.size();
+      auto ptr = reinterpret_cast<const ubyte_8*>(data);
+      buf.insert(buf.end(), ptr, ptr + count * sizeof(T));
+      if constexpr (needsByteSwap<T>) {
+         for (std::size_t i = 0; i < count; i++) {
+            T value;
+            std::memcpy(&value, buf.data() + start + i * sizeof(T), sizeof(T));
+            byteSwap(value);
+            std::memcpy(buf.data() + start + i * sizeof(T), &value, sizeof(T));
+         }
+      }
+   }
+
+   template<typename T>
+   inline bool readBulk(std::span<const ubyte_8> buf, ulong_64& offset, T* data, std::size_t count) {
+      if (offset > buf.size() || count > (buf.size() - offset) / sizeof(T)) return false;
+      if (count) std::memcpy(data, buf.data() + offset, count * sizeof(T));
+      offset += count * sizeof(T);
+      if constexpr (needsByteSwap<T>) {
+         for (std::size_t i = 0; i < count; i++) byteSwap(data[i]);
+      }
+      return true;
+   }
+
+   template<Encoding E>
+   inline void writeLength(std::vector<ubyte_8>& buf, ulong_64 size) {
+      if constexpr (E == Encoding::Fixed) {
+         writeBulk(buf, &size, 1);
+      } else {
+         writeVarint(buf, size);
+      }
+   }
+
+   // Also rejects lengths that point past the end of buf.
+   template<Encoding E>
+   inline bool readLength(std::span<const ubyte_8> buf, ulong_64& offset, ulong_64& size) {
+      if constexpr (E == Encoding::Fixed) {
+         if (!readBulk(buf, offset, &size, 1)) return false;
+      } else {
+         if (!readVarint(buf, offset, size)) return false;
+      }
+      return size <= buf.size() - offset;
+   }
+
+   constexpr std::size_t varintSize(ulong_64 v) {
+      std::size_t size = 1;
+      while (v >= 0x80) {
+         v >>= 7;
+         size++;
+      }
+      return size;
+   }
+
+   template<Encoding E>
+   constexpr std::size_t lengthSize(ulong_64 size) {
+      if constexpr (E == Encoding::Fixed) return sizeof(ulong_64);
+      else return varintSize(size);
+   }
+
+   // Types whose encoded size does not depend on the value.
+   template<Encoding E, typename T>
+   constexpr bool isFixedSize() {
+      if constexpr (std::is_same_v<T, std::string> || SerializableType<T> || is_specialization<T, std::vector>::value
+         || is_specialization<T, std::map>::value || is_span<T>::value) return false;
+      else if constexpr (is_std_array<T>::value) return isFixedSize<E, typename T::value_type>();
+      else if constexpr (isVarintInteger<E, T>) return false;
+      else return std::is_trivially_copyable_v<T>;
+   }
+
+   template<Encoding E, typename T>
+   constexpr std::size_t fixedSize() {
+      if constexpr (is_std_array<T>::value) return std::tuple_size_v<T> * fixedSize<E, typename T::value_type>();
+      else return sizeof(T);
+   }
+
+   template<Encoding E = Encoding::Fixed, typename T>
+   inline std::size_t sizeOf(const T& v) {
+      if constexpr (isFixedSize<E, T>()) {
+         return fixedSize<E, T>();
+      }
+      else if constexpr (std::is_same_v<T, std::string>) {
+         return lengthSize<E>(v.size()) + v.size();
+      }
+      else if constexpr (SerializableType<T>) {
+         std::size_t inner = v.serializedSize();
+         return lengthSize<E>(inner) + inner;
+      }
+      else if constexpr (is_specialization<T, std::vector>::value || is_span<T>::value) {
+         using Element = std::remove_cv_t<typename T::value_type>;
+         if constexpr (isFixedSize<E, Element>()) return lengthSize<E>(v.size()) + v.size() * fixedSize<E, Element>();
+         else {
+            std::size_t size = lengthSize<E>(v.size());
+            for (auto& e : v) size += sizeOf<E>(e);
+            return size;
+         }
+      }
+      else if constexpr (is_std_array<T>::value) {
+         std::size_t size = 0;
+         for (auto& e : v) size += sizeOf<E>(e);
+         return size;
+      }
+      else if constexpr (is_specialization<T, std::map>::value) {
+         std::size_t size = lengthSize<E>(v.size());
+         for (auto& [k, val] : v) size += sizeOf<E>(k) + sizeOf<E>(val);
+         return size;
+      }
+      else if constexpr (isVarintInteger<E, T>) {
+         if constexpr (std::is_signed_v<T>) return varintSize(zigZagEncode(v));
+         else return varintSize(v);
+      }
+      else {
+         static_assert(sizeof(T) == 0, "Unsupported type for sizeOf");
+      }
+   }
+
+   // Messages made only of fixed size fields get their size as a compile time constant.
+   template<Encoding E, typename... Ts>
+   constexpr bool isFixedLayout = (isFixedSize<E, Ts>() && ...);
+
+   template<Encoding E = Encoding::Fixed, typename... Ts>
+   inline std::size_t serializedSizeOf(const Ts&... fields) {
+      if constexpr (isFixedLayout<E, Ts...>) {
+         constexpr std::size_t size = (fixedSize<E, Ts>() + ... + 0);
+         return size;
+      } else {
+         return (sizeOf<E>(fields) + ... + 0);
+      }
+   }
+
+   // How SERIALIZABLE may copy its fields: Auto uses one memcpy when the fields allow it,
+   // Required (SERIALIZABLE_PACKED) insists on it and None always goes field by field.
+   enum class Packing {
+      None,
+      Auto,
+      Required
+   };
+
+   template<Encoding E, typename T>
+   constexpr bool isPackedField() {
+      if constexpr (is_std_array<T>::value) return isPackedField<E, typename T::value_type>();
+      else return isBulkElement<E, T> && !needsByteSwap<T>;
+   }
+
+   template<Encoding E, typename... Ts>
+   constexpr bool isPackable = (isPackedField<E, Ts>() && ...);
+
+   // True when every field starts where the one before it ends, see PN_FIELDS_LAYOUT.
+   template<std::size_t N>
+   constexpr bool isContiguousLayout(const std::array<std::size_t, N>& offsets, const std::array<std::size_t, N>& sizes) {
+      for (std::size_t i = 1; i < N; i++) {
+         if (offsets[i] != offsets[i - 1] + sizes[i - 1]) return false;
+      }
+      return true;
+   }
+
+   // Whether SERIALIZABLE copies the fields with one memcpy, decided at compile time.
+   template<Encoding E, Packing P, bool Contiguous, typename... Ts>
+   constexpr bool packedFields() {
+      if constexpr (P == Packing::Required) {
+         static_assert(isPackable<E, Ts...>, "SERIALIZABLE_PACKED fields must be trivially copyable, fixed size and need no byte swap");
+         static_assert(Contiguous, "SERIALIZABLE_PACKED fields have padding or are not in declaration order");
+         return true;
+      } else if constexpr (P == Packing::Auto && sizeof...(Ts) > 1 && isPackable<E, Ts...>) {
+         return Contiguous;
+      } else {
+         return false;
+      }
+   }
+
+   template<typename... Ts>
+   struct FieldTypes {
+      template<Encoding E>
+      static constexpr ulong_64 layoutHash(std::string_view names) {
+         constexpr ulong_64 prime = 1099511628211ull;
+         ulong_64 hash = 14695981039346656037ull;
+         for (char c : names) hash = (hash ^ static_cast<ubyte_8>(c)) * prime;
+         ((hash = (hash ^ (sizeof(Ts) << 3 | fieldKind<Ts>())) * prime), ...);
+         return (hash ^ static_cast<ulong_64>(E)) * prime;
+      }
+
+   private:
+      template<typename T>
+      static constexpr ulong_64 fieldKind() {
+         if constexpr (std::is_same_v<T, std::string>) return 1;
+         else if constexpr (SerializableType<T>) return 2;
+         else if constexpr (is_specialization<T, std::vector>::value || is_span<T>::value) return 3;
+         else if constexpr (is_specialization<T, std::map>::value) return 4;
+         else if constexpr (is_std_array<T>::value) return 5;
+         else if constexpr (std::is_floating_point_v<T>) return 6;
+         else if constexpr (std::is_integral_v<T>) return 7;
+         else return 0;
+      }
+   };
+
+   // Only used in decltype to name the field types of SERIALIZABLE.
+   template<typename... Ts>
+   FieldTypes<Ts...> fieldTypes(const Ts&...);
+
+   //<POD types>
+   template<Encoding E = Encoding::Fixed, typename T>
    inline void writeAny(std::vector<ubyte_8>& buf, const T& v) {
       if constexpr (std::is_same_v<T, std::string>) {
-         writeAny(buf, static_cast<ulong_64>(v.size()));
+         writeLength<E>(buf, v.size());
          buf.insert(buf.end(), v.begin(), v.end());
       }
       else if constexpr (SerializableType<T>) {
-         auto tmp = v.serialize();
-         writeAny(buf, tmp);
+         // Encoded in place: the fixed length slot is patched afterwards, a varint needs the size up front.
+         if constexpr (E == Encoding::Fixed) {
+            std::size_t start = buf.size();
+            writeLength<E>(buf, 0);
+            v.serializeInto(buf);
+            ulong_64 size = buf.size() - start - sizeof(ulong_64);
+            if constexpr (needsByteSwap<ulong_64>) byteSwap(size);
+            std::memcpy(buf.data() + start, &size, sizeof(size));
+         } else {
+            writeLength<E>(buf, v.serializedSize());
+            v.serializeInto(buf);
+         }
       }
       else if constexpr (std::is_same_v<T, std::vector<ubyte_8>>) {
-         writeAny(buf, static_cast<ulong_64>(v.size()));
+         writeLength<E>(buf, v.size());
          buf.insert(buf.end(), v.begin(), v.end());
       }
-      else if constexpr (is_specialization<T, std::vector>::value) {
-         writeAny(buf, static_cast<ulong_64>(v.size()));
-         for (auto& e : v) writeAny(buf, e);
+      else if constexpr (is_specialization<T, std::vector>::value || is_span<T>::value) {
+         using Element = std::remove_cv_t<typename T::value_type>;
+         writeLength<E>(buf, v.size());
+         if constexpr (isBulkElement<E, Element>) writeBulk(buf, v.data(), v.size());
+         else for (auto& e : v) writeAny<E>(buf, e);
+      }
+      else if constexpr (is_std_array<T>::value) {
+         if constexpr (isBulkElement<E, typename T::value_type>) writeBulk(buf, v.data(), v.size());
+         else for (auto& e : v) writeAny<E>(buf, e);
       }
       else if constexpr (is_specialization<T, std::map>::value) {
-         writeAny(buf, static_cast<ulong_64>(v.size()));
+         writeLength<E>(buf, v.size());
          for (auto& [k, val] : v) {
-               writeAny(buf, k);
-               writeAny(buf, val);
+               writeAny<E>(buf, k);
+               writeAny<E>(buf, val);
          }
       }
+      else if constexpr (isVarintInteger<E, T>) {
+         if constexpr (std::is_signed_v<T>) writeVarint(buf, zigZagEncode(v));
+         else writeVarint(buf, v);
+      }
       else if constexpr (std::is_trivially_copyable_v<T>) {
-         auto ptr = reinterpret_cast<const ubyte_8*>(&v);
-         buf.insert(buf.end(), ptr, ptr + sizeof(T));
+         writeBulk(buf, &v, 1);
       }
       else {
          static_assert(sizeof(T) == 0, "Unsupported type for writeAny");
       }
    }
 
-   template<typename T>
-   inline bool readAny(const std::vector<ubyte_8>& buf, ulong_64& offset, T& v) {
+   template<Encoding E = Encoding::Fixed, typename T>
+   inline bool readAny(std::span<const ubyte_8> buf, ulong_64& offset, T& v) {
       if constexpr (std::is_same_v<T, std::string>) {
          ulong_64 size;
-         if (!readAny(buf, offset, size)) return false;
-         if (offset + size > buf.size()) return false;
+         if (!readLength<E>(buf, offset, size)) return false;
          v.assign(reinterpret_cast<const char*>(buf.data() + offset), size);
          offset += size;
          return true;
       }
       else if constexpr (SerializableType<T>) {
-         std::vector<ubyte_8> tmp;
-         if (!readAny(buf, offset, tmp)) return false;
-         ulong_64 innerOffset = 0;
-         return v.deserialize(tmp, innerOffset);
+         // Decoded in place from a view that ends with its length, so the nested message
+         // cannot read the outer message's bytes; it may leave some of its own unread.
+         ulong_64 size;
+         if (!readLength<E>(buf, offset, size)) return false;
+         ulong_64 end = offset + size;
+         ulong_64 innerOffset = offset;
+         if (!v.deserialize(buf.first(end), innerOffset)) return false;
+         offset = end;
+         return true;
       }
       else if constexpr (std::is_same_v<T, std::vector<ubyte_8>>) {
          ulong_64 size;
-         if (!readAny(buf, offset, size)) return false;
-         if (offset + size > buf.size()) return false;
+         if (!readLength<E>(buf, offset, size)) return false;
          v.assign(buf.begin() + offset, buf.begin() + offset + size);
          offset += size;
          return true;
       }
       else if constexpr (is_specialization<T, std::vector>::value) {
          ulong_64 size;
-         if (!readAny(buf, offset, size)) return false;
-         v.clear();
-         v.reserve(size);
-         for (ulong_64 i = 0; i < size; i++) {
-            typename T::value_type tmp;
-            if (!readAny(buf, offset, tmp)) return false;
-            v.push_back(std::move(tmp));
+         if (!readLength<E>(buf, offset, size)) return false;
+         if constexpr (isBulkElement<E, typename T::value_type>) {
+            if (size > (buf.size() - offset) / sizeof(typename T::value_type)) return false;
+            v.resize(size);
+            return readBulk(buf, offset, v.data(), size);
+         } else {
+            v.clear();
+            v.reserve(size);
+            for (ulong_64 i = 0; i < size; i++) {
+               typename T::value_type tmp;
+               if (!readAny<E>(buf, offset, tmp)) return false;
+               v.push_back(std::move(tmp));
+            }
+            return true;
+         }
+      }
+      else if constexpr (is_span<T>::value) {
+         static_assert(!std::is_const_v<typename T::element_type>, "readAny needs a writable span");
+         // Reads in place, the encoded length has to match the span.
+         ulong_64 size;
+         if (!readLength<E>(buf, offset, size)) return false;
+         if (size != v.size()) return false;
+         if constexpr (isBulkElement<E, typename T::value_type>) return readBulk(buf, offset, v.data(), v.size());
+         else {
+            for (auto& e : v) {
+               if (!readAny<E>(buf, offset, e)) return false;
+            }
+            return true;
+         }
+      }
+      else if constexpr (is_std_array<T>::value) {
+         if constexpr (isBulkElement<E, typename T::value_type>) return readBulk(buf, offset, v.data(), v.size());
+         else {
+            for (auto& e : v) {
+               if (!readAny<E>(buf, offset, e)) return false;
+            }
+            return true;
          }
-         return true;
       }
       else if constexpr (is_specialization<T, std::map>::value) {
          ulong_64 size;
-         if (!readAny(buf, offset, size)) return false;
+         if (!readLength<E>(buf, offset, size)) return false;
          v.clear();
          for (ulong_64 i = 0; i < size; i++) {
             typename T::key_type key;
             typename T::mapped_type val;
-            if (!readAny(buf, offset, key)) return false;
-            if (!readAny(buf, offset, val)) return false;
+            if (!readAny<E>(buf, offset, key)) return false;
+            if (!readAny<E>(buf, offset, val)) return false;
             v.emplace(std::move(key), std::move(val));
          }
          return true;
       }
-      else if constexpr (std::is_trivially_copyable_v<T>) {
-         if (offset + sizeof(T) > buf.size()) return false;
-         std::memcpy(&v, buf.data() + offset, sizeof(T));
-         offset += sizeof(T);
+      else if constexpr (isVarintInteger<E, T>) {
+         ulong_64 raw;
+         if (!readVarint(buf, offset, raw)) return false;
+         if constexpr (std::is_signed_v<T>) {
+            std::int64_t value = zigZagDecode(raw);
+            if (value < std::numeric_limits<T>::min() || value > std::numeric_limits<T>::max()) return false;
+            v = static_cast<T>(value);
+         } else {
+            if (raw > std::numeric_limits<T>::max()) return false;
+            v = static_cast<T>(raw);
+         }
          return true;
       }
+      else if constexpr (std::is_trivially_copyable_v<T>) {
+         return readBulk(buf, offset, &v, 1);
+      }
       else {
          static_assert(sizeof(T) == 0, "Unsupported type for readAny");
       }
    }
    //<~POD types>
 
+   template<Encoding E = Encoding::Fixed, Packing P = Packing::None, bool Contiguous = false>
    inline void serializeFields(std::vector<ubyte_8>&) {}
 
-   template<typename T, typename... Rest>
+   template<Encoding E = Encoding::Fixed, Packing P = Packing::None, bool Contiguous = false, typename T, typename... Rest>
    inline void serializeFields(std::vector<ubyte_8>& buf, const T& first, const Rest&... rest) {
-      writeAny(buf, first);
-      serializeFields(buf, rest...);
+      if constexpr (packedFields<E, P, Contiguous, T, Rest...>()) {
+         writeBulk(buf, reinterpret_cast<const ubyte_8*>(&first), (sizeof(T) + ... + sizeof(Rest)));
+      } else {
+         writeAny<E>(buf, first);
+         serializeFields<E>(buf, rest...);
+      }
    }
 
-   inline bool deserializeFields(const std::vector<ubyte_8>&, ulong_64&) { return true; }
+   template<Encoding E = Encoding::Fixed, Packing P = Packing::None, bool Contiguous = false>
+   inline bool deserializeFields(std::span<const ubyte_8>, ulong_64&) { return true; }
 
-   template<typename T, typename... Rest>
-   inline bool deserializeFields(const std::vector<ubyte_8>& buf, ulong_64& offset, T& first, Rest&... rest) {
-      if (!readAny(buf, offset, first)) return false;
-      return deserializeFields(buf, offset, rest...);
+   template<Encoding E = Encoding::Fixed, Packing P = Packing::None, bool Contiguous = false, typename T, typename... Rest>
+   inline bool deserializeFields(std::span<const ubyte_8> buf, ulong_64& offset, T& first, Rest&... rest) {
+      if constexpr (packedFields<E, P, Contiguous, T, Rest...>()) {
+         return readBulk(buf, offset, reinterpret_cast<ubyte_8*>(&first), (sizeof(T) + ... + sizeof(Rest)));
+      } else {
+         if (!readAny<E>(buf, offset, first)) return false;
+         return deserializeFields<E>(buf, offset, rest...);
+      }
    }
    
-   template <typename T = DefaultPacket, typename U = T, typename = std::enable_if_t<std::is_base_of_v<PacketNetPacket, T> && std::is_base_of_v<PacketNetPacket, U>>>
-   class PacketNetServer;
+   // msg framed as a P packet in one pooled buffer of the exact size.
+   template<FrameWritable P, SerializableType M>
+   inline std::vector<ubyte_8> frameMessage(const M& msg, BufferPool& pool = BufferPool::defaultPool()) {
+      FrameWriter<P> writer(pool, msg.serializedSize());
+      msg.serializeInto(writer.payload());
+      return writer.finish();
+   }
 
+   // Binary framing with a 4..17 byte header instead of DefaultPacket's 22 bytes of markers:
+   //    marker(0xC5) flags len(varint) type(varint) payload
+   // DefaultPacket frames are read as well, the first byte tells the formats apart, so
+   // peers can switch formats between frames. See FrameNegotiation for when compact
+   // frames are written; type and flags are 0 on frames that arrived as DefaultPacket.
+   struct CompactPacket : PacketNetPacket {
+      constexpr static ubyte_8 marker = 0xC5;
+      constexpr static ulong_64 maxPacketSize = DefaultPacket::maxPacketSize;
+      constexpr static std::size_t maxVarintSize = 10;
+      // Appended to the handshake payload by a peer that offers compact frames.
+      constexpr static std::string_view offerTrailer = "<~PC>";
+
+      ubyte_8 flags = 0;
+      std::uint32_t type = 0;
+      ulong_64 len = 0;
+      std::vector<ubyte_8> data;
 
-   template <typename T = DefaultPacket, typename U = T, typename = std::enable_if_t<std::is_base_of_v<PacketNetPacket, T> && std::is_base_of_v<PacketNetPacket, U>>>
-   class PacketNetClient : public StreamedNetClient {
-   public:
-      using StreamedNetClient::StreamedNetClient;
+      CompactPacket() = default;
 
-      void sendHandshake() {
-         sendHandshake(U());
+      CompactPacket(const std::vector<ubyte_8>& packetData, std::uint32_t packetType = 0, ubyte_8 packetFlags = 0) : flags(packetFlags), type(packetType) {
+         data = packetData;
+         len = data.size();
       }
 
-      void sendHandshake(const U& pkt) {
-         if(!firstSend) return;
-         send(pkt.serialize());
-         firstSend = false;
+      ~CompactPacket() override {
+         BufferPool::defaultPool().release(std::move(data));
       }
 
-      void sendPacket(const T& pkt) {
-         if(firstSend) {
-            U handshakePacket = pkt;
-            send(handshakePacket.serialize());
-            firstSend = false;
-         } else {
-            send(pkt.serialize());
+      bool deserializeHead(const StreamBuffer& incoming) override {
+         if(incoming.empty()) return false;
+         legacy = incoming.data()[0] != marker;
+         trailerSize = 0;
+         if(legacy) {
+            if(incoming.size() < DefaultPacket::headSpecifier.size() + 8) return false;
+            std::memcpy(&len, incoming.data() + DefaultPacket::headSpecifier.size(), 8);
+            headerSize = DefaultPacket::headSpecifier.size() + 8;
+            trailerSize = DefaultPacket::endSpecifier.size();
+            valid = std::string_view(reinterpret_cast<const char*>(incoming.data()), DefaultPacket::headSpecifier.size()) == DefaultPacket::headSpecifier;
+            flags = 0;
+            type = 0;
+            return true;
+         }
+
+         std::span<const ubyte_8> head(incoming.data(), std::min(incoming.size(), 2 + 2 * maxVarintSize));
+         if(head.size() < 2) return false;
+         flags = head[1];
+         ulong_64 offset = 2;
+         ulong_64 packetType = 0;
+         if(!readVarint(head, offset, len) || !readVarint(head, offset, packetType)) {
+            // Incomplete while a varint runs into the end of what arrived, malformed once it
+            // stopped early, i.e. does not fit 64 bits, or both could have ended.
+            if(offset >= head.size() && head.size() < 2 + 2 * maxVarintSize) return false;
+            valid = false;
+            return true;
          }
+         valid = packetType <= std::numeric_limits<std::uint32_t>::max();
+         type = static_cast<std::uint32_t>(packetType);
+         headerSize = offset;
+         return true;
       }
 
-   protected:
-      virtual void onReceive(const std::vector<ubyte_8>& data) override {
-         incoming.insert(incoming.end(), data.begin(), data.end());
-         // std::cout << "FullPacket: " << StringUtil::bytesToString(incoming) << "\n";
-         processPackets();
+      bool checkHead() override {
+         if(!frameFits(headerSize, len, trailerSize, maxPacketSize)) return false;
+         return valid;
       }
 
-      virtual void onHandshake(const T& pkt) {}
-      virtual void onPacket(const U& pkt) {}
+      bool deserializeEnd(const StreamBuffer& incoming) override {
+         if(incoming.size() < frameSize()) return false;
+         if(legacy) {
+            std::string_view end(reinterpret_cast<const char*>(incoming.data() + headerSize + len), DefaultPacket::endSpecifier.size());
+            valid = end == DefaultPacket::endSpecifier;
+         }
+         return true;
+      }
 
-      bool firstReceive = true;
-      bool firstSend = true;
+      bool checkEnd() override {
+         return valid;
+      }
 
-   private:
-      std::vector<ubyte_8> incoming;
+      // Strips offerTrailer from a received handshake, true if the peer offered compact frames.
+      bool takeOffer(const StreamBuffer& incoming) {
+         if(!legacy || len < offerTrailer.size()) return false;
+         std::string_view tail(reinterpret_cast<const char*>(incoming.data() + headerSize + len - offerTrailer.size()), offerTrailer.size());
+         if(tail != offerTrailer) return false;
+         len -= offerTrailer.size();
+         trailerSize += offerTrailer.size();
+         return true;
+      }
 
-      void processPackets() {
-         while (true) {
-            if(firstReceive) {
-               T handShakeP;
+      std::vector<ubyte_8>& readData(const StreamBuffer& incoming) override {
+         if (data.capacity() < len) data = BufferPool::defaultPool().acquire(len);
+         data.assign(incoming.begin() + headerSize, incoming.begin() + headerSize + len);
+         return data;
+      }
 
-               if(!handShakeP.deserializeHead(incoming)) break;
-               if(!handShakeP.checkHead()) { this->disconnect(); incoming.clear(); return; }
-               if(!handShakeP.deserializeEnd(incoming)) break;
-               if(!handShakeP.checkEnd()) { this->disconnect(); incoming.clear(); return; }
+      std::span<const ubyte_8> viewData(const StreamBuffer& incoming) const override {
+         return { incoming.data() + headerSize, len };
+      }
 
-               handShakeP.readData(incoming);
-               onHandshake(handShakeP);
-               handShakeP.erase(incoming);
+      ulong_64 frameSize() const override {
+         return headerSize + len + trailerSize;
+      }
 
-               firstReceive = false;
-            } else {
-               U dataP;
+      void erase(StreamBuffer& incoming) override {
+         incoming.consume(frameSize());
+      }
 
-               if(!dataP.deserializeHead(incoming)) break;
-               if(!dataP.checkHead()) { this->disconnect(); incoming.clear(); return; }
-               if(!dataP.deserializeEnd(incoming)) break;
-               if(!dataP.checkEnd()) { this->disconnect(); incoming.clear(); return; }
+      bool isLegacy() const {
+         return legacy;
+      }
 
-               dataP.readData(incoming);
-               onPacket(dataP);
-               dataP.erase(incoming);
-            } 
+      std::vector<ubyte_8> serialize() const override {
+         std::vector<ubyte_8> buf = BufferPool::defaultPool().acquire(2 + 2 * maxVarintSize + data.size());
+         buf.push_back(marker);
+         buf.push_back(flags);
+         writeVarint(buf, data.size());
+         writeVarint(buf, type);
+         buf.insert(buf.end(), data.begin(), data.end());
+         return buf;
+      }
+
+      // The payload in DefaultPacket framing, with offerTrailer appended if offer is set.
+      std::vector<ubyte_8> serializeDefault(bool offer = false) const {
+         std::vector<ubyte_8> buf = BufferPool::defaultPool().acquire(DefaultPacket::frameOverhead + data.size() + offerTrailer.size());
+         std::size_t start = DefaultPacket::beginFrame(buf);
+         buf.insert(buf.end(), data.begin(), data.end());
+         if(offer) buf.insert(buf.end(), offerTrailer.begin(), offerTrailer.end());
+         DefaultPacket::endFrame(buf, start);
+         return buf;
+      }
+
+      // Frame writing with a 4 byte length slot: a padded varint, so the payload never moves.
+      constexpr static std::size_t frameOverhead = 2 + 4 + 1;
+      constexpr static ulong_64 maxSlotLength = (ulong_64(1) << 28) - 1;
+      static_assert(maxPacketSize <= maxSlotLength, "compact frames must fit the length slot");
+
+      static std::size_t beginFrame(std::vector<ubyte_8>& buf) {
+         std::size_t start = buf.size();
+         buf.insert(buf.end(), { marker, 0, 0x80, 0x80, 0x80, 0x00, 0x00 });
+         return start;
+      }
+
+      // Throws std::length_error above maxPacketSize, a peer drops the connection over such a frame.
+      static void endFrame(std::vector<ubyte_8>& buf, std::size_t start) {
+         ulong_64 payloadLen = buf.size() - start - frameOverhead;
+         if(payloadLen > maxPacketSize) throw std::length_error("CompactPacket payload above maxPacketSize");
+         for (std::size_t i = 0; i < 4; i++) {
+            buf[start + 2 + i] = static_cast<ubyte_8>((payloadLen >> (7 * i)) & 0x7F) | (i < 3 ? 0x80 : 0x00);
          }
       }
+
+      // Received compact or DefaultPacket frames, one or several back to back, re-framed as
+      // DefaultPacket for peers without compact frames.
+      static std::vector<ubyte_8> toDefaultFrame(std::span<const ubyte_8> frames, BufferPool& pool = BufferPool::defaultPool()) {
+         std::vector<ubyte_8> buf = pool.acquire(frames.size() + DefaultPacket::frameOverhead);
+         while(!frames.empty()) {
+            if(frames[0] != marker) {
+               if(frames.size() < DefaultPacket::frameOverhead) break;
+               ulong_64 payloadLen = 0;
+               std::memcpy(&payloadLen, frames.data() + DefaultPacket::headSpecifier.size(), 8);
+               std::size_t frameLen = std::min<ulong_64>(DefaultPacket::frameOverhead + payloadLen, frames.size());
+               buf.insert(buf.end(), frames.begin(), frames.begin() + frameLen);
+               frames = frames.subspan(frameLen);
+               continue;
+            }
+
+            ulong_64 offset = 2;
+            ulong_64 payloadLen = 0;
+            ulong_64 packetType = 0;
+            if(frames.size() < 2 || !readVarint(frames, offset, payloadLen) || !readVarint(frames, offset, packetType)) break;
+            payloadLen = std::min<ulong_64>(payloadLen, frames.size() - offset);
+            std::size_t start = DefaultPacket::beginFrame(buf);
+            buf.insert(buf.end(), frames.begin() + offset, frames.begin() + offset + payloadLen);
+            DefaultPacket::endFrame(buf, start);
+            frames = frames.subspan(offset + payloadLen);
+         }
+         return buf;
+      }
+
+   private:
+      bool legacy = false;
+      bool valid = true;
+      std::size_t headerSize = 0;
+      std::size_t trailerSize = 0;
    };
 
+   // Frames that end at a delimiter byte instead of carrying a length, e.g. '\n' for line
+   // based text. The payload must not contain the delimiter.
+   template<ubyte_8 Delimiter = '\n'>
+   struct DelimitedPacket {
+      constexpr static ulong_64 maxPacketSize = 64*1024;
+      ulong_64 len = 0;
+      std::vector<ubyte_8> data;
 
-   template <typename T = DefaultPacket, typename U = T, typename = std::enable_if_t<std::is_base_of_v<PacketNetPacket, T> && std::is_base_of_v<PacketNetPacket, U>>>
-   class PacketNetConnection : public StreamedNetConnection {
-   public:
-      using StreamedNetConnection::StreamedNetConnection;
+      DelimitedPacket() = default;
 
-      PacketNetConnection(asio::io_context& context, PacketNetServer<T, U>& serverRef, tcp::socket& accepted) : StreamedNetConnection(context, serverRef, accepted) {}
+      DelimitedPacket(const std::vector<ubyte_8>& packetData) : len(packetData.size()), data(packetData) {}
 
-      PacketNetServer<T, U>& getServer() {
-         return static_cast<PacketNetServer<T, U>&>(StreamedNetConnection::getServer());
+      ~DelimitedPacket() {
+         BufferPool::defaultPool().release(std::move(data));
       }
 
+      bool deserializeHead(const StreamBuffer& incoming) {
+         std::size_t window = std::min<std::size_t>(incoming.size(), maxPacketSize);
+         const void* end = std::memchr(incoming.data(), Delimiter, window);
+         if(end == nullptr) {
+            // Without a delimiter in the first maxPacketSize bytes the frame is too long.
+            tooLong = window == maxPacketSize;
+            return tooLong;
+         }
+         len = static_cast<const ubyte_8*>(end) - incoming.data();
+         return true;
+      }
+
+      bool checkHead() {
+         return !tooLong;
+      }
+
+      bool deserializeEnd(const StreamBuffer&) {
+         return true;
+      }
+
+      bool checkEnd() {
+         return true;
+      }
+
+      std::vector<ubyte_8>& readData(const StreamBuffer& incoming) {
+         if (data.capacity() < len) data = BufferPool::defaultPool().acquire(len);
+         data.assign(incoming.begin(), incoming.begin() + len);
+         return data;
+      }
+
+      std::span<const ubyte_8> viewData(const StreamBuffer& incoming) const {
+         return { incoming.data(), len };
+      }
+
+      ulong_64 frameSize() const {
+         return len + 1;
+      }
+
+      void erase(StreamBuffer& incoming) {
+         incoming.consume(frameSize());
+      }
+
+      std::vector<ubyte_8> serialize() const {
+         std::vector<ubyte_8> buf = BufferPool::defaultPool().acquire(frameOverhead + data.size());
+         std::size_t start = beginFrame(buf);
+         buf.insert(buf.end(), data.begin(), data.end());
+         endFrame(buf, start);
+         return buf;
+      }
+
+      constexpr static std::size_t frameOverhead = 1;
+
+      static std::size_t beginFrame(std::vector<ubyte_8>& buf) {
+         return buf.size();
+      }
+
+      static void endFrame(std::vector<ubyte_8>& buf, std::size_t start) {
+         assert(std::find(buf.begin() + start, buf.end(), Delimiter) == buf.end() && "payload contains the delimiter");
+         buf.push_back(Delimiter);
+      }
+
+   private:
+      bool tooLong = false;
+   };
+
+   // Frames of exactly Size bytes without any header, for streams of fixed size records.
+   // Shorter payloads are zero padded when sent.
+   template<std::size_t Size>
+   struct FixedSizePacket {
+      constexpr static ulong_64 len = Size;
+      std::vector<ubyte_8> data;
+
+      FixedSizePacket() = default;
+
+      FixedSizePacket(const std::vector<ubyte_8>& packetData) : data(packetData) {}
+
+      ~FixedSizePacket() {
+         BufferPool::defaultPool().release(std::move(data));
+      }
+
+      bool deserializeHead(const StreamBuffer& incoming) {
+         return incoming.size() >= Size;
+      }
+
+      bool checkHead() {
+         return true;
+      }
+
+      bool deserializeEnd(const StreamBuffer&) {
+         return true;
+      }
+
+      bool checkEnd() {
+         return true;
+      }
+
+      std::vector<ubyte_8>& readData(const StreamBuffer& incoming) {
+         if (data.capacity() < Size) data = BufferPool::defaultPool().acquire(Size);
+         data.assign(incoming.begin(), incoming.begin() + Size);
+         return data;
+      }
+
+      std::span<const ubyte_8> viewData(const StreamBuffer& incoming) const {
+         return { incoming.data(), Size };
+      }
+
+      ulong_64 frameSize() const {
+         return Size;
+      }
+
+      void erase(StreamBuffer& incoming) {
+         incoming.consume(Size);
+      }
+
+      std::vector<ubyte_8> serialize() const {
+         std::vector<ubyte_8> buf = BufferPool::defaultPool().acquire(Size);
+         std::size_t start = beginFrame(buf);
+         buf.insert(buf.end(), data.begin(), data.end());
+         endFrame(buf, start);
+         return buf;
+      }
+
+      constexpr static std::size_t frameOverhead = 0;
+
+      static std::size_t beginFrame(std::vector<ubyte_8>& buf) {
+         return buf.size();
+      }
+
+      static void endFrame(std::vector<ubyte_8>& buf, std::size_t start) {
+         assert(buf.size() - start <= Size && "payload larger than the fixed frame size");
+         buf.resize(start + Size);
+      }
+   };
+
+   template<typename P>
+   constexpr bool negotiatesFrames = std::is_base_of_v<CompactPacket, P>;
+
+   // Compact frame negotiation of one peer, only active for packet types deriving from CompactPacket.
+   // Handshakes always go out in DefaultPacket framing; with offer set they carry
+   // CompactPacket::offerTrailer, and once the peer's handshake carried it as well
+   // packets are written compact. Peers that only know DefaultPacket see the trailer
+   // as part of the handshake payload.
+   struct FrameNegotiation {
+      std::atomic<bool> offer = false;
+      std::atomic<bool> agreed = false;
+
+      template<typename P>
+      std::vector<ubyte_8> handshakeFrame(const P& pkt) const {
+         if constexpr (negotiatesFrames<P>) return pkt.serializeDefault(offer);
+         else return pkt.serialize();
+      }
+
+      template<typename P>
+      std::vector<ubyte_8> packetFrame(const P& pkt) const {
+         if constexpr (negotiatesFrames<P>) return agreed ? pkt.serialize() : pkt.serializeDefault();
+         else return pkt.serialize();
+      }
+
+      template<typename P, SerializableType M>
+      std::vector<ubyte_8> handshakeFrame(const M& msg, BufferPool& pool) const {
+         if constexpr (negotiatesFrames<P>) {
+            FrameWriter<DefaultPacket> writer(pool, msg.serializedSize() + CompactPacket::offerTrailer.size());
+            msg.serializeInto(writer.payload());
+            if(offer) writer.payload().insert(writer.payload().end(), CompactPacket::offerTrailer.begin(), CompactPacket::offerTrailer.end());
+            return writer.finish();
+         } else {
+            return frameMessage<P>(msg, pool);
+         }
+      }
+
+      template<typename P, SerializableType M>
+      std::vector<ubyte_8> packetFrame(const M& msg, BufferPool& pool) const {
+         if constexpr (negotiatesFrames<P>) {
+            if(!agreed) return frameMessage<DefaultPacket>(msg, pool);
+         }
+         return frameMessage<P>(msg, pool);
+      }
+
+      // Whether an already framed packet can be sent to this peer as is.
+      template<typename P>
+      bool accepts(std::span<const ubyte_8> frame) const {
+         if constexpr (negotiatesFrames<P>) return agreed || frame.empty() || frame[0] != CompactPacket::marker;
+         else return true;
+      }
+
+      template<typename P>
+      void receiveHandshake(P& pkt, const StreamBuffer& incoming) {
+         if constexpr (negotiatesFrames<P>) {
+            bool peerOffered = pkt.takeOffer(incoming);
+            agreed = offer && peerOffered;
+         }
+      }
+   };
+
+   template <FrameCodec T = DefaultPacket, FrameCodec U = T>
+   class PacketNetServer;
+
+   // Packet framing on top of a StreamedNetClient or StreamedNetConnection: T frames the
+   // handshake, U every packet after it.
+   template <typename Base, FrameCodec T, FrameCodec U>
+   class PacketNetEndpoint : public Base {
+   public:
+      using HandshakeType = T;
+      using PacketType = U;
+
+      using Base::Base;
+
       void sendHandshake() {
          sendHandshake(U());
       }
 
       void sendHandshake(const U& pkt) {
-         if(!firstSend) return;
-         send(pkt.serialize());
-         firstSend = false;
+         if(sendFirst([&]() { this->send(negotiation.handshakeFrame(pkt)); })) this->recordPacketOut();
       }
 
       void sendPacket(const T& pkt) {
-         if(firstSend) {
+         bool handshake = sendFirst([&]() {
             U handshakePacket = pkt;
-            send(handshakePacket.serialize());
-            firstSend = false;
-         } else {
-            send(pkt.serialize());
+            this->send(negotiation.handshakeFrame(handshakePacket));
+            });
+         if(!handshake) this->send(negotiation.packetFrame(pkt));
+         this->recordPacketOut();
+      }
+
+      // Serializes msg straight into the outbound frame, without a T in between.
+      template<SerializableType M> requires FrameWritable<T> && FrameWritable<U>
+      void sendPacket(const M& msg) {
+         bool handshake = sendFirst([&]() { this->send(negotiation.template handshakeFrame<U>(msg, framePool())); });
+         if(!handshake) this->send(negotiation.template packetFrame<T>(msg, framePool()));
+         this->recordPacketOut();
+      }
+
+      // Coroutine API over the same socket, codecs and negotiation. Await it on the endpoint's
+      // executor (StreamedNetClient::getContext(), StreamedNetConnection::getStrand()) and only
+      // read this way while no read loop runs: a client connected through connect(), a
+      // connection with awaitReads set. Reads give nullopt and writes false once the
+      // connection failed; a malformed frame disconnects, like it does for the callbacks.
+      // readHandshake also gives nullopt once the handshake was received, later frames are packets.
+      asio::awaitable<std::optional<T>> readHandshake() {
+         if(!firstReceive) co_return std::nullopt;
+         co_return co_await readFrame<T>(true);
+      }
+
+      // The peer's handshake is read and dropped first if it did not arrive yet.
+      asio::awaitable<std::optional<U>> readPacket() {
+         if(firstReceive) {
+            std::optional<T> handshake = co_await readHandshake();
+            if(!handshake) co_return std::nullopt;
          }
+         co_return co_await readFrame<U>(false);
+      }
+
+      // The write is started before the first suspension, and the coroutine runs on the
+      // strand, so packets sent from other threads meanwhile still queue behind it.
+      asio::awaitable<bool> writeHandshake(const U& pkt) {
+         std::vector<ubyte_8> frame;
+         if(!sendFirst([&]() { frame = negotiation.handshakeFrame(pkt); })) co_return true;
+         this->recordPacketOut();
+         asio::error_code ec = co_await this->write(framePool().share(std::move(frame)));
+         co_return !ec;
+      }
+
+      asio::awaitable<bool> writePacket(const T& pkt) {
+         std::vector<ubyte_8> frame;
+         bool handshake = sendFirst([&]() {
+            U handshakePacket = pkt;
+            frame = negotiation.handshakeFrame(handshakePacket);
+            });
+         if(!handshake) frame = negotiation.packetFrame(pkt);
+         this->recordPacketOut();
+         asio::error_code ec = co_await this->write(framePool().share(std::move(frame)));
+         co_return !ec;
+      }
+
+      template<SerializableType M> requires FrameWritable<T> && FrameWritable<U>
+      asio::awaitable<bool> writePacket(const M& msg) {
+         std::vector<ubyte_8> frame;
+         bool handshake = sendFirst([&]() { frame = negotiation.template handshakeFrame<U>(msg, framePool()); });
+         if(!handshake) frame = negotiation.template packetFrame<T>(msg, framePool());
+         this->recordPacketOut();
+         asio::error_code ec = co_await this->write(framePool().share(std::move(frame)));
+         co_return !ec;
       }
 
    protected:
-      void onReceive(const std::vector<ubyte_8>& data) override {
-         incoming.insert(incoming.end(), data.begin(), data.end());
-         // std::cout << "FullPacket: " << StringUtil::bytesToString(incoming) << "\n";
-         processPackets();
+      void onReceiveBuffer(StreamBuffer& incoming) override {
+         processPackets(incoming);
       }
 
       virtual void onHandshake(const T& pkt) {}
       virtual void onPacket(const U& pkt) {}
+      virtual void onHandshakeView(const PacketView& pkt) {}
+      virtual void onPacketView(const PacketView& pkt) {}
+      // Every packet decoded from one read, with batchPacketViews set. Views are only valid inside the call.
+      virtual void onPackets(std::span<const PacketView> pkts) {}
+
+      // Connections frame into their own pool, clients into the default one.
+      BufferPool& framePool() {
+         if constexpr (std::is_base_of_v<StreamedNetConnection, Base>) return this->getBufferPool();
+         else return BufferPool::defaultPool();
+      }
+
+      // Runs send, which frames the handshake, if it did not go out yet, and tells whether it did.
+      // broadcast and publish send from foreign threads: concurrent senders wait until send
+      // returned, so there is one handshake and nothing they send overtakes it.
+      template<typename F>
+      bool sendFirst(F&& send) {
+         if(!firstSend.load(std::memory_order_acquire)) return false;
+         std::lock_guard<std::mutex> lock(firstSendMutex);
+         if(!firstSend.load(std::memory_order_relaxed)) return false;
+         send();
+         firstSend.store(false, std::memory_order_release);
+         return true;
+      }
 
       bool firstReceive = true;
-      bool firstSend = true;
+      std::atomic<bool> firstSend = true;
+      bool usePacketViews = false;
+      bool batchPacketViews = false;
+      FrameNegotiation negotiation;
 
    private:
-      std::vector<ubyte_8> incoming;
-
-      void processPackets() {
-         while (true) {
-            if(firstReceive) {
-               T handShakeP;
-
-               if(!handShakeP.deserializeHead(incoming)) break;
-               if(!handShakeP.checkHead()) { this->disconnect(); incoming.clear(); return; }
-               if(!handShakeP.deserializeEnd(incoming)) break;
-               if(!handShakeP.checkEnd()) { this->disconnect(); incoming.clear(); return; }
-
+      std::mutex firstSendMutex;
+
+      // Delivers every complete frame in incoming and leaves a trailing partial one buffered.
+      void processPackets(StreamBuffer& incoming) {
+         if(firstReceive) {
+            auto start = std::chrono::steady_clock::now();
+            std::chrono::steady_clock::time_point decoded;
+            T handShakeP;
+
+            FrameStatus status = decodeFrame(handShakeP, incoming);
+            if(status == FrameStatus::Incomplete) return;
+            if(status == FrameStatus::Malformed) { this->disconnect(); incoming.clear(); return; }
+            negotiation.receiveHandshake(handShakeP, incoming);
+
+            if(usePacketViews) {
+               decoded = std::chrono::steady_clock::now();
+               onHandshakeView({ handShakeP.viewData(incoming), { incoming.data(), handShakeP.frameSize() } });
+            } else {
                handShakeP.readData(incoming);
+               decoded = std::chrono::steady_clock::now();
                onHandshake(handShakeP);
-               handShakeP.erase(incoming);
+            }
+            this->recordPacketIn(start, decoded);
+            handShakeP.T::erase(incoming);
 
-               firstReceive = false;
-            } else {
-               U dataP;
+            firstReceive = false;
+         }
+
+         if(batchPacketViews) {
+            processBatch(incoming);
+            return;
+         }
 
-               if(!dataP.deserializeHead(incoming)) break;
-               if(!dataP.checkHead()) { this->disconnect(); incoming.clear(); return; }
-               if(!dataP.deserializeEnd(incoming)) break;
-               if(!dataP.checkEnd()) { this->disconnect(); incoming.clear(); return; }
+         while (true) {
+            auto start = std::chrono::steady_clock::now();
+            std::chrono::steady_clock::time_point decoded;
+            U dataP;
+
+            FrameStatus status = decodeFrame(dataP, incoming);
+            if(status == FrameStatus::Incomplete) return;
+            if(status == FrameStatus::Malformed) { this->disconnect(); incoming.clear(); return; }
 
+            if(usePacketViews) {
+               decoded = std::chrono::steady_clock::now();
+               onPacketView({ dataP.viewData(incoming), { incoming.data(), dataP.frameSize() } });
+            } else {
                dataP.readData(incoming);
+               decoded = std::chrono::steady_clock::now();
                onPacket(dataP);
-               dataP.erase(incoming);
-            } 
+            }
+            this->recordPacketIn(start, decoded);
+            dataP.U::erase(incoming);
+         }
+      }
+
+      // erase only advances the read cursor, the bytes stay in place until the next read,
+      // so views of already erased frames remain valid for onPackets.
+      void processBatch(StreamBuffer& incoming) {
+         auto start = std::chrono::steady_clock::now();
+         FrameStatus status = FrameStatus::Complete;
+         viewBatch.clear();
+         while (true) {
+            U dataP;
+            status = decodeFrame(dataP, incoming);
+            if(status != FrameStatus::Complete) break;
+            viewBatch.push_back({ dataP.viewData(incoming), { incoming.data(), dataP.frameSize() } });
+            dataP.U::erase(incoming);
+         }
+
+         if(!viewBatch.empty()) {
+            auto decoded = std::chrono::steady_clock::now();
+            onPackets(viewBatch);
+            for (std::size_t i = 0; i < viewBatch.size(); i++) this->recordPacketIn(start, decoded);
+         }
+         if(status == FrameStatus::Malformed) { this->disconnect(); incoming.clear(); }
+      }
+
+      // Decodes the next P from the read buffer, awaiting more data while the frame is incomplete.
+      template<typename P>
+      asio::awaitable<std::optional<P>> readFrame(bool handshake) {
+         StreamBuffer& incoming = this->getReadBuffer();
+         while (true) {
+            auto start = std::chrono::steady_clock::now();
+            P pkt;
+            FrameStatus status = decodeFrame(pkt, incoming);
+            if(status == FrameStatus::Complete) {
+               if(handshake) {
+                  negotiation.receiveHandshake(pkt, incoming);
+                  firstReceive = false;
+               }
+               pkt.readData(incoming);
+               this->recordPacketIn(start, std::chrono::steady_clock::now());
+               pkt.P::erase(incoming);
+               co_return pkt;
+            }
+            if(status == FrameStatus::Malformed) { this->disconnect(); incoming.clear(); co_return std::nullopt; }
+            asio::error_code ec = co_await this->readSome();
+            if(ec) co_return std::nullopt;
+         }
+      }
+
+      std::vector<PacketView> viewBatch;
+   };
+
+
+   template <FrameCodec T = DefaultPacket, FrameCodec U = T>
+   class PacketNetClient : public PacketNetEndpoint<StreamedNetClient, T, U> {
+   public:
+      using PacketNetEndpoint<StreamedNetClient, T, U>::PacketNetEndpoint;
+   };
+
+
+   template <FrameCodec T = DefaultPacket, FrameCodec U = T>
+   class PacketNetConnection : public PacketNetEndpoint<StreamedNetConnection, T, U> {
+   public:
+      using PacketNetEndpoint<StreamedNetConnection, T, U>::PacketNetEndpoint;
+      using PacketNetEndpoint<StreamedNetConnection, T, U>::sendPacket;
+
+      PacketNetConnection(asio::io_context& context, PacketNetServer<T, U>& serverRef, tcp::socket& accepted) : PacketNetEndpoint<StreamedNetConnection, T, U>(context, serverRef, accepted) {}
+
+      PacketNetServer<T, U>& getServer() {
+         return static_cast<PacketNetServer<T, U>&>(StreamedNetConnection::getServer());
+      }
+
+      // frame must be pkt.serialize(); it is shared as is once the handshake went out
+      void sendPacket(const T& pkt, const SharedBuffer& frame) {
+         if(this->firstSend || !this->negotiation.template accepts<T>(*frame)) {
+            sendPacket(pkt);
+         } else {
+            this->send(frame);
+            this->recordPacketOut();
          }
       }
+
+      // frame is an already framed packet, e.g. PacketView::shareFrame() of a received one
+      void sendFrame(const SharedBuffer& frame) {
+         if(this->firstSend) this->sendHandshake();
+         if(this->negotiation.template accepts<T>(*frame)) this->send(frame);
+         else this->send(CompactPacket::toDefaultFrame(*frame, this->getBufferPool()));
+         this->recordPacketOut();
+      }
+
+      // Already framed packets, e.g. a FrameHistory replay, sent in one gathered write.
+      void sendFrames(std::vector<SharedBuffer> frames) {
+         if(frames.empty()) return;
+         if(this->firstSend) this->sendHandshake();
+         for (auto& frame : frames) {
+            if(!this->negotiation.template accepts<T>(*frame)) frame = this->getBufferPool().share(CompactPacket::toDefaultFrame(*frame, this->getBufferPool()));
+         }
+         std::size_t count = frames.size();
+         this->send(std::move(frames));
+         for (std::size_t i = 0; i < count; i++) this->recordPacketOut();
+      }
    };
 
 
-   template <typename T, typename U, typename>
+   template <FrameCodec T, FrameCodec U>
    class PacketNetServer : public StreamedNetServer {
    public:
       using StreamedNetServer::StreamedNetServer;
 
+      // Typed copy of the connection list, broadcasts walk the shared snapshot instead.
       std::vector<std::shared_ptr<PacketNetConnection<T, U>>> getConnections() {
+         ConnectionSnapshot snapshot = StreamedNetServer::getConnections();
          std::vector<std::shared_ptr<PacketNetConnection<T, U>>> out;
-         for (auto& conn : StreamedNetServer::getConnections()) {
+         out.reserve(snapshot->size());
+         for (auto& conn : *snapshot) {
             out.emplace_back(std::static_pointer_cast<PacketNetConnection<T, U>>(conn));
          }
          return out;
       }
 
+      std::shared_ptr<PacketNetConnection<T, U>> getConnection(ConnectionId id) {
+         return std::static_pointer_cast<PacketNetConnection<T, U>>(StreamedNetServer::getConnection(id));
+      }
+
+      void broadcast(const T& pkt) {
+         broadcast(pkt, [](const PacketNetConnection<T, U>&) { return true; });
+      }
+
+      template <typename Filter>
+      void broadcast(const T& pkt, Filter&& filter) {
+         SharedBuffer frame = getBufferPool()->share(pkt.serialize());
+         forEachConnection(filter, [&](PacketNetConnection<T, U>& conn) {
+            conn.sendPacket(pkt, frame);
+         });
+      }
+
+      template <typename Filter>
+      void broadcastFrame(const SharedBuffer& frame, Filter&& filter) {
+         forEachConnection(filter, [&](PacketNetConnection<T, U>& conn) {
+            conn.sendFrame(frame);
+         });
+      }
+
+      // Rooms: publish only reaches the connections that joined the room, disconnecting leaves all of them.
+      bool join(const std::string& room, PacketNetConnection<T, U>& connection) {
+         if (connection.getId() == invalidConnectionId) return false;
+         return rooms.join(room, connection.getId(), std::static_pointer_cast<PacketNetConnection<T, U>>(connection.shared_from_this()));
+      }
+
+      // join, then the room's retained frames numbered above since in one write. A publish
+      // racing with it reaches connection exactly once, either live or in the replay.
+      // Returns the sequence number of the room's newest frame, pass it back as since to resume.
+      // With a log, a since the history no longer reaches back to is caught up from the log;
+      // 0 only replays what the history retains.
+      std::uint64_t joinAndReplay(const std::string& room, PacketNetConnection<T, U>& connection, std::uint64_t since = 0) {
+         std::unique_lock<std::mutex> lock;
+         std::shared_ptr<History> history = lockHistory(room, lock);
+         if (!history) {
+            join(room, connection);
+            return 0;
+         }
+         if (!join(room, connection)) return history->frames.lastSequence();
+         std::vector<SharedBuffer> frames;
+         std::uint64_t dropped = history->frames.droppedSequence();
+         if (log && since != 0 && since < dropped) {
+            log->read(since, dropped, [&](std::uint64_t, std::string_view key, std::span<const ubyte_8> frame) {
+               if (key == room) frames.emplace_back(copyFrame(frame));
+            });
+         }
+         std::vector<SharedBuffer> retained = history->frames.since(since);
+         if (frames.empty()) frames = std::move(retained);
+         else frames.insert(frames.end(), retained.begin(), retained.end());
+         connection.sendFrames(std::move(frames));
+         return history->frames.lastSequence();
+      }
+
+      bool leave(const std::string& room, PacketNetConnection<T, U>& connection) {
+         return rooms.leave(room, connection.getId());
+      }
+
+      bool isInRoom(const std::string& room, PacketNetConnection<T, U>& connection) {
+         return rooms.isMember(room, connection.getId());
+      }
+
+      std::size_t getRoomSize(const std::string& room) {
+         return rooms.memberCount(room);
+      }
+
+      std::vector<std::string> getRooms(PacketNetConnection<T, U>& connection) {
+         return rooms.roomsOf(connection.getId());
+      }
+
+      void publish(const std::string& room, const T& pkt) {
+         publish(room, pkt, [](const PacketNetConnection<T, U>&) { return true; });
+      }
+
+      // Serializes pkt once, and without history or log not at all when nobody is in the room.
+      template <typename Filter>
+      void publish(const std::string& room, const T& pkt, Filter&& filter) {
+         if (historyFrames == 0 && !log) {
+            auto members = rooms.members(room);
+            if (members->empty()) return;
+            SharedBuffer frame = getBufferPool()->share(pkt.serialize());
+            forEachConnection(*members, filter, [&](PacketNetConnection<T, U>& conn) {
+               conn.sendPacket(pkt, frame);
+            });
+            return;
+         }
+
+         SharedBuffer frame = getBufferPool()->share(pkt.serialize());
+         auto lock = record(room, frame);
+         forEachConnection(*rooms.members(room), filter, [&](PacketNetConnection<T, U>& conn) {
+            conn.sendPacket(pkt, frame);
+         });
+      }
+
+      template <typename Filter>
+      void publishFrame(const std::string& room, const SharedBuffer& frame, Filter&& filter) {
+         auto lock = record(room, frame);
+         forEachConnection(*rooms.members(room), filter, [&](PacketNetConnection<T, U>& conn) {
+            conn.sendFrame(frame);
+         });
+      }
+
+      // Every room keeps its last frames published, up to maxBytes of them, for joinAndReplay,
+      // members or not. Room names come from clients, so only the maxRooms most recently used
+      // histories are kept. Frames are numbered across all rooms, a since handed out for a
+      // room stays valid after its history was evicted. 0 frames, the default, keeps none.
+      // Set it before start().
+      void setHistory(std::size_t frames, std::size_t maxBytes = std::numeric_limits<std::size_t>::max(), std::size_t maxRooms = 256) {
+         historyFrames = frames;
+         historyBytes = maxBytes;
+         historyRooms = std::max<std::size_t>(maxRooms, 1);
+         std::lock_guard<std::mutex> lock(historiesMutex);
+         seedHistories();
+      }
+
+      // Sequence number of the newest frame published to room, 0 without history.
+      std::uint64_t getHistorySequence(const std::string& room) {
+         std::shared_ptr<History> history = findHistory(room, false);
+         if (!history) return 0;
+         std::lock_guard<std::mutex> lock(history->mutex);
+         return history->frames.lastSequence();
+      }
+
+      // Published frames are also appended to log, keyed by room. Histories then number frames
+      // like the log does and start out with their room's newest logged frames, so a restarted
+      // server has something to replay. Those are read here and by setHistory, in one pass over
+      // the log, histories created later never read it. False once the server started.
+      bool setLog(std::shared_ptr<FrameLog> frameLog) {
+         if (isOnline()) return false;
+         std::lock_guard<std::mutex> lock(historiesMutex);
+         log = std::move(frameLog);
+         seedHistories();
+         return true;
+      }
+
+      // Forgets the frames of room, numbering goes on where it was.
+      void clearHistory(const std::string& room) {
+         std::shared_ptr<History> history = findHistory(room, false);
+         if (!history) return;
+         std::lock_guard<std::mutex> lock(history->mutex);
+         history->frames.clear();
+      }
+
       void onDisconnect(std::shared_ptr<StreamedNetConnection> connection) override {
+         rooms.leaveAll(connection->getId());
          auto derivedConn = std::static_pointer_cast<PN::PacketNetConnection<T, U>>(connection);
          onDisconnect(derivedConn);
       }
 
       virtual void onDisconnect(std::shared_ptr<PN::PacketNetConnection<T, U>> connection) {}
+
+   private:
+      // Filters take the connection by reference, which walks the snapshot without touching
+      // reference counts, or as a shared_ptr like getConnections() hands them out.
+      template <typename Filter, typename Fn>
+      void forEachConnection(Filter& filter, Fn&& fn) {
+         forEachConnection(*StreamedNetServer::getConnections(), filter, fn);
+      }
+
+      template <typename List, typename Filter, typename Fn>
+      void forEachConnection(const List& list, Filter& filter, Fn&& fn) {
+         for (auto& ptr : list) {
+            auto& conn = static_cast<PacketNetConnection<T, U>&>(*ptr);
+            if constexpr (std::is_invocable_r_v<bool, Filter&, PacketNetConnection<T, U>&>) {
+               if (!filter(conn)) continue;
+            } else {
+               if (!filter(std::static_pointer_cast<PacketNetConnection<T, U>>(ptr))) continue;
+            }
+            fn(conn);
+         }
+      }
+
+      struct History {
+         History(std::size_t frames, std::size_t maxBytes) : frames(frames, maxBytes) {}
+
+         // Held across append and fan-out, so replays and live sends don't overlap.
+         std::mutex mutex;
+         FrameHistory frames;
+         // Set under mutex once the history no longer is the room's.
+         bool evicted = false;
+      };
+
+      struct HistoryEntry {
+         std::shared_ptr<History> history;
+         std::list<std::string>::iterator used;
+      };
+
+      // Logs frame and appends it to the room's history. The returned lock, held across the
+      // fan-out, keeps joinAndReplay from interleaving with it.
+      std::unique_lock<std::mutex> record(const std::string& room, const SharedBuffer& frame) {
+         std::unique_lock<std::mutex> lock;
+         std::shared_ptr<History> history = lockHistory(room, lock);
+         std::uint64_t seq = log ? log->append(room, frame) : 0;
+         if (history && !log) seq = ++sequence;
+         if (history) {
+            // Frames the log refused keep the history's own numbering.
+            if (seq > history->frames.lastSequence()) history->frames.append(frame, seq);
+            else history->frames.append(frame);
+         }
+         return lock;
+      }
+
+      // The history of room, created if needed, locked into lock. Null without history.
+      std::shared_ptr<History> lockHistory(const std::string& room, std::unique_lock<std::mutex>& lock) {
+         std::shared_ptr<History> history = findHistory(room, true);
+         while (history) {
+            lock = std::unique_lock<std::mutex>(history->mutex);
+            if (!history->evicted) break;
+            // Evicted meanwhile, the room's frames go to the history that replaces it.
+            lock.unlock();
+            history = findHistory(room, true);
+         }
+         return history;
+      }
+
+      // The history of room, null without history or if there is none yet and create is false.
+      std::shared_ptr<History> findHistory(const std::string& room, bool create) {
+         if (historyFrames == 0) return nullptr;
+         std::unique_lock<std::mutex> lock(historiesMutex);
+         auto it = histories.find(room);
+         if (it != histories.end()) {
+            recent.splice(recent.begin(), recent, it->second.used);
+            return it->second.history;
+         }
+         if (!create) return nullptr;
+
+         std::shared_ptr<History> history = std::make_shared<History>(historyFrames, historyBytes);
+         // The room's older frames, if any, went with an evicted history.
+         history->frames.dropTo(evictedSequence);
+         recent.push_front(room);
+         histories.emplace(room, HistoryEntry{ history, recent.begin() });
+         while (histories.size() > historyRooms) evictOldest();
+         return history;
+      }
+
+      // Call it with historiesMutex held.
+      void evictOldest() {
+         auto it = histories.find(recent.back());
+         {
+            std::lock_guard<std::mutex> lock(it->second.history->mutex);
+            it->second.history->evicted = true;
+            evictedSequence = std::max(evictedSequence, it->second.history->frames.lastSequence());
+         }
+         histories.erase(it);
+         recent.pop_back();
+      }
+
+      // Replaces the histories with the newest logged frames of the maxRooms most recently
+      // logged rooms. The first pass only keeps sequence numbers, the second one copies the
+      // frames still wanted out of the mapping. Call it with historiesMutex held.
+      void seedHistories() {
+         histories.clear();
+         recent.clear();
+         evictedSequence = 0;
+         if (!log || historyFrames == 0) return;
+
+         struct Logged {
+            std::deque<std::uint64_t> seqs;
+            std::uint64_t dropped = 0;
+            std::list<std::string>::iterator used;
+         };
+         std::unordered_map<std::string, Logged> logged;
+         std::uint64_t upTo = log->lastSequence();
+         log->read(0, upTo, [&](std::uint64_t seq, std::string_view key, std::span<const ubyte_8>) {
+            std::string room(key);
+            auto it = logged.find(room);
+            if (it == logged.end()) {
+               recent.push_front(room);
+               it = logged.emplace(std::move(room), Logged{ {}, evictedSequence, recent.begin() }).first;
+               if (logged.size() > historyRooms) {
+                  auto oldest = logged.find(recent.back());
+                  evictedSequence = std::max(evictedSequence, oldest->second.seqs.back());
+                  logged.erase(oldest);
+                  recent.pop_back();
+               }
+            } else {
+               recent.splice(recent.begin(), recent, it->second.used);
+            }
+            auto& seqs = it->second.seqs;
+            if (seqs.size() == historyFrames) {
+               it->second.dropped = seqs.front();
+               seqs.pop_front();
+            }
+            seqs.push_back(seq);
+         });
+
+         std::uint64_t from = upTo;
+         for (auto& [room, entry] : logged) {
+            auto history = std::make_shared<History>(historyFrames, historyBytes);
+            history->frames.dropTo(entry.dropped);
+            histories.emplace(room, HistoryEntry{ std::move(history), entry.used });
+            from = std::min(from, entry.seqs.front() - 1);
+         }
+         log->read(from, upTo, [&](std::uint64_t seq, std::string_view key, std::span<const ubyte_8> frame) {
+            auto it = logged.find(std::string(key));
+            if (it == logged.end() || seq < it->second.seqs.front()) return;
+            histories.find(it->first)->second.history->frames.append(copyFrame(frame), seq);
+         });
+      }
+
+      SharedBuffer copyFrame(std::span<const ubyte_8> frame) {
+         BufferPool& pool = *getBufferPool();
+         std::vector<ubyte_8> buf = pool.acquire(frame.size());
+         buf.assign(frame.begin(), frame.end());
+         return pool.share(std::move(buf));
+      }
+
+      RoomIndex<PacketNetConnection<T, U>> rooms;
+      std::size_t historyFrames = 0;
+      std::size_t historyBytes = std::numeric_limits<std::size_t>::max();
+      std::size_t historyRooms = 256;
+      std::mutex historiesMutex;
+      std::unordered_map<std::string, HistoryEntry> histories;
+      // Most recently used room first.
+      std::list<std::string> recent;
+      // Newest frame of any evicted history.
+      std::uint64_t evictedSequence = 0;
+      // Numbers frames without a log, the log numbers them otherwise.
+      std::atomic<std::uint64_t> sequence = 0;
+      std::shared_ptr<FrameLog> log;
    };
 }
 
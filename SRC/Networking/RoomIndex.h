@@ -0,0 +1,119 @@
+#ifndef NETWORK_ROOM_INDEX_H
+#define NETWORK_ROOM_INDEX_H
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "ConnectionRegistry.h"
+
+namespace SN {
+   // Room name -> subscribers. Every room is a ConnectionRegistry, so joins and leaves are
+   // O(1) and members() hands out the same dense snapshot until the membership changes.
+   // Connections are keyed by their server ConnectionId; rooms without members are dropped.
+   template<typename C>
+   class RoomIndex {
+   public:
+      using Snapshot = typename ConnectionRegistry<C>::Snapshot;
+
+      // False if connection already is a member.
+      bool join(const std::string& room, ConnectionId connection, std::shared_ptr<C> member) {
+         std::lock_guard<std::mutex> lock(mutex);
+         auto& joined = memberships[connection];
+         for (auto& membership : joined) {
+            if (membership.room->name == room) return false;
+         }
+         auto& entry = rooms[room];
+         if (!entry) {
+            entry = std::make_unique<Room>();
+            entry->name = room;
+         }
+         joined.push_back({ entry.get(), entry->members.add(std::move(member)) });
+         return true;
+      }
+
+      // False if connection was not a member.
+      bool leave(const std::string& room, ConnectionId connection) {
+         std::lock_guard<std::mutex> lock(mutex);
+         auto it = memberships.find(connection);
+         if (it == memberships.end()) return false;
+         auto& joined = it->second;
+         for (std::size_t i = 0; i < joined.size(); i++) {
+            if (joined[i].room->name != room) continue;
+            removeMember(joined[i]);
+            joined[i] = joined.back();
+            joined.pop_back();
+            if (joined.empty()) memberships.erase(it);
+            return true;
+         }
+         return false;
+      }
+
+      void leaveAll(ConnectionId connection) {
+         std::lock_guard<std::mutex> lock(mutex);
+         auto it = memberships.find(connection);
+         if (it == memberships.end()) return;
+         for (auto& membership : it->second) removeMember(membership);
+         memberships.erase(it);
+      }
+
+      // Current subscribers of room, empty for unknown rooms.
+      Snapshot members(const std::string& room) {
+         std::lock_guard<std::mutex> lock(mutex);
+         auto it = rooms.find(room);
+         if (it == rooms.end()) return empty;
+         return it->second->members.snapshot();
+      }
+
+      bool isMember(const std::string& room, ConnectionId connection) {
+         std::lock_guard<std::mutex> lock(mutex);
+         auto it = memberships.find(connection);
+         if (it == memberships.end()) return false;
+         for (auto& membership : it->second) {
+            if (membership.room->name == room) return true;
+         }
+         return false;
+      }
+
+      std::size_t memberCount(const std::string& room) {
+         std::lock_guard<std::mutex> lock(mutex);
+         auto it = rooms.find(room);
+         return it == rooms.end() ? 0 : it->second->members.size();
+      }
+
+      std::vector<std::string> roomsOf(ConnectionId connection) {
+         std::lock_guard<std::mutex> lock(mutex);
+         std::vector<std::string> out;
+         auto it = memberships.find(connection);
+         if (it == memberships.end()) return out;
+         for (auto& membership : it->second) out.emplace_back(membership.room->name);
+         return out;
+      }
+
+   private:
+      struct Room {
+         std::string name;
+         ConnectionRegistry<C> members;
+      };
+
+      struct Membership {
+         Room* room;
+         ConnectionId member;
+      };
+
+      void removeMember(const Membership& membership) {
+         Room* room = membership.room;
+         room->members.remove(membership.member);
+         if (room->members.size() == 0) rooms.erase(rooms.find(room->name));
+      }
+
+      std::mutex mutex;
+      std::unordered_map<std::string, std::unique_ptr<Room>> rooms;
+      std::unordered_map<ConnectionId, std::vector<Membership>> memberships;
+      const Snapshot empty = std::make_shared<const typename ConnectionRegistry<C>::List>();
+   };
+}
+
+#endif //NETWORK_ROOM_INDEX_H
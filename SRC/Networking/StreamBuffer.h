@@ -0,0 +1,86 @@
+#ifndef NETWORK_STREAM_BUFFER_H
+#define NETWORK_STREAM_BUFFER_H
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "../Util/AsioInclude.h"
+#include "BufferPool.h"
+
+namespace SN {
+   // Receive buffer that the socket reads into directly. Consumed bytes only
+   // advance a cursor; the unread tail is moved to the front when a read needs
+   // the room, so draining many frames from one read stays linear. Storage is
+   // borrowed from a BufferPool on the first read and handed back by release().
+   class StreamBuffer {
+   public:
+      explicit StreamBuffer(BufferPool& pool = BufferPool::defaultPool()) : pool(&pool) {}
+      ~StreamBuffer() { release(); }
+
+      StreamBuffer(const StreamBuffer&) = delete;
+      StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+      // At least minFree bytes to write into. Only what is handed out is sized, so the
+      // storage is not zero filled past the largest prepare since it was acquired.
+      asio::mutable_buffer prepare(std::size_t minFree) {
+         if (storage.capacity() == 0) storage = pool->acquire(minFree);
+         if (storage.capacity() - writePos < minFree) compact();
+         if (storage.size() < writePos + minFree) storage.resize(writePos + minFree);
+         return asio::buffer(storage.data() + writePos, storage.size() - writePos);
+      }
+
+      // Room for one read of up to chunk bytes. Hands out what is free and only compacts or
+      // grows once less than a quarter of chunk is left, so frames split across reads don't
+      // grow the buffer past the chunk it was acquired for.
+      asio::mutable_buffer prepareRead(std::size_t chunk) {
+         if (storage.capacity() == 0) storage = pool->acquire(chunk);
+         if (storage.capacity() - writePos < chunk / 4) compact();
+         if (storage.capacity() - writePos < chunk / 4) return prepare(chunk);
+         return prepare(std::min(chunk, storage.capacity() - writePos));
+      }
+
+      void commit(std::size_t length) {
+         writePos += length;
+      }
+
+      void consume(std::size_t length) {
+         readPos += length;
+         if (readPos >= writePos) clear();
+      }
+
+      void clear() {
+         readPos = 0;
+         writePos = 0;
+      }
+
+      // Returns the storage to the pool, only possible while nothing is buffered.
+      void release() {
+         if (!empty() || storage.capacity() == 0) return;
+         pool->release(std::move(storage));
+         storage = {};
+      }
+
+      const ubyte_8* data() const { return storage.data() + readPos; }
+      const ubyte_8* begin() const { return data(); }
+      const ubyte_8* end() const { return storage.data() + writePos; }
+      std::size_t size() const { return writePos - readPos; }
+      bool empty() const { return readPos == writePos; }
+      std::size_t capacity() const { return storage.capacity(); }
+
+   private:
+      void compact() {
+         if (readPos == 0) return;
+         std::memmove(storage.data(), storage.data() + readPos, writePos - readPos);
+         writePos -= readPos;
+         readPos = 0;
+      }
+
+      BufferPool* pool;
+      std::vector<ubyte_8> storage;
+      std::size_t readPos = 0;
+      std::size_t writePos = 0;
+   };
+}
+
+#endif //NETWORK_STREAM_BUFFER_H
@@ -2,18 +2,25 @@
 #include "StreamedNetImpl.h"
 #include <memory>
 #include <iostream>
+#include <cstring>
+#include <future>
 
 using namespace SN;
 using namespace SNImpl;
 using SNC = StreamedNetClient;
 using SNS = StreamedNetServer;
 
+// 16 KiB, exactly a BufferPool size class, so a read buffer takes no more than one read.
+constexpr std::size_t readChunkSize = BufferPool::minClassSize << 6;
+// How long close() lets the pool finish the server's own work before stopping it.
+constexpr std::chrono::seconds closeTimeout{ 2 };
+
 /*CLIENT*/
-Client::Client(asio::io_context& context, StreamedNetClient& parent) : context_(context), parentRef(&parent), resolver(context), socket(context), readBuffer(20 * 1024), writeBuffer(20 * 1024) {}
+Client::Client(asio::io_context& context, StreamedNetClient& parent) : context_(context), parentRef(&parent), resolver(context), socket(context), writeSignal(context) {}
 
 void Client::autoConnect(const std::string& host, ushort_16 port) {
    if (HasFlag(state, SNC::Online)) {
-      if (parentRef) parentRef->onError(SNC::Error::AlreadyConnected, ec);
+      if (parentRef) parentRef->reportError(SNC::Error::AlreadyConnected, ec);
       return;
    }
    AddFlag(state, SNC::Online);
@@ -22,18 +29,21 @@ void Client::autoConnect(const std::string& host, ushort_16 port) {
 
    host_ = host;
    port_ = port;
+   readBuffer.clear();
 
    auto self(shared_from_this());
    auto connectLambda = [this, self](const std::error_code& ec, const tcp::endpoint& endpoints_) {
       connectedEndpoints = endpoints_;
       if (ec) {
-         if (parentRef) parentRef->onError(SNC::Error::ConnectFailed, ec);
+         if (parentRef) parentRef->reportError(SNC::Error::ConnectFailed, ec);
          clientAbort();
          return;
       }
       RemoveFlag(state, StreamedNetClient::Connecting);
 
       if (parentRef) {
+         parentRef->metrics.accepted.fetch_add(1, std::memory_order_relaxed);
+         parentRef->metrics.active.store(1, std::memory_order_relaxed);
          parentRef->onEvent(SNC::Event::Connected);
          parentRef->onConnect();
       }
@@ -43,7 +53,7 @@ void Client::autoConnect(const std::string& host, ushort_16 port) {
    auto resolveLambda = [this, connectLambda, self](const std::error_code& ec, tcp::resolver::results_type endpoints_) {
       resolvedEndpoints = endpoints_;
       if (ec) {
-         if (parentRef) parentRef->onError(SNC::Error::ResolveFailed, ec);
+         if (parentRef) parentRef->reportError(SNC::Error::ResolveFailed, ec);
 
          clientAbort();
          return;
@@ -61,33 +71,51 @@ void Client::autoConnect(const std::string& host, ushort_16 port) {
    if (parentRef) parentRef->startThread();
 }
 
-void Client::send(const std::vector<ubyte_8>& msg) {
+void Client::send(std::vector<ubyte_8>&& msg) {
    auto self(shared_from_this());
-   asio::post(context_, [this, msg, self]() {
-      std::copy(msg.begin(), msg.end(), writeBuffer.begin());
-
-      auto writeLambda = [this, msg, self](std::error_code ec, std::size_t length) {
-         if (ec) {
-            clientAbort();
-            if (ec == asio::error::eof || ec == asio::error::connection_reset) {
-               if (parentRef) parentRef->onError(SNC::Error::ConnectionClosed, ec);
-               return;
-            } else if (ec == asio::error::operation_aborted) {
-               if (parentRef) parentRef->onError(SNC::Error::Aborted, ec);
-               return;
-            } else {
-               if (parentRef) parentRef->onError(SNC::Error::WriteFailed, ec);
-               return;
-            }
-         }
-         if (parentRef) parentRef->onEvent(SNC::Event::DataSent);
-         };
-      if (socket.is_open()) {
-         asio::async_write(socket, asio::buffer(writeBuffer.data(), msg.size()), writeLambda);
-      } else if (parentRef) parentRef->onError(SNC::Error::ConnectionClosed, ec);
+   asio::post(context_, [this, self, msg = std::move(msg)]() mutable {
+      if (!socket.is_open()) {
+         if (parentRef) parentRef->reportError(SNC::Error::ConnectionClosed, ec);
+         return;
+      }
+      writeQueue.push(std::move(msg));
+      if (!writeQueue.isWriting()) writeData();
    });
 }
 
+void Client::writeData() {
+   auto self(shared_from_this());
+   auto writeLambda = [this, self](std::error_code ec, std::size_t length) {
+      writeDone(ec, length);
+      };
+
+   const auto& buffers = writeQueue.prepare();
+   if (parentRef) parentRef->metrics.writeQueueDepth.record(buffers.size());
+   asio::async_write(socket, buffers, writeLambda);
+}
+
+void Client::writeDone(const std::error_code& ec, std::size_t length) {
+   writeQueue.complete(ec);
+   writeSignal.cancel();
+   if (ec) {
+      writeQueue.clear();
+      clientAbort();
+      if (ec == asio::error::eof || ec == asio::error::connection_reset) {
+         if (parentRef) parentRef->reportError(SNC::Error::ConnectionClosed, ec);
+      } else if (ec == asio::error::operation_aborted) {
+         if (parentRef) parentRef->reportError(SNC::Error::Aborted, ec);
+      } else {
+         if (parentRef) parentRef->reportError(SNC::Error::WriteFailed, ec);
+      }
+      return;
+   }
+   if (parentRef) {
+      parentRef->metrics.traffic.bytesOut.fetch_add(length, std::memory_order_relaxed);
+      parentRef->onEvent(SNC::Event::DataSent);
+   }
+   if (writeQueue.hasPending()) writeData();
+}
+
 void Client::disconnect() {
    auto self(shared_from_this());
    asio::post(context_, [this, self]() {
@@ -100,26 +128,113 @@ void Client::readData() {
    auto self(shared_from_this());
    auto readLambda = [this, self](std::error_code ec, std::size_t length) {
       if (ec) {
-         clientAbort();
-         if (ec == asio::error::eof || ec == asio::error::connection_reset) {
-            if (parentRef) parentRef->onError(SNC::Error::ConnectionClosed, ec);
-            return;
-         } else if (ec == asio::error::operation_aborted) {
-            if (parentRef) parentRef->onError(SNC::Error::Aborted, ec);
-            return;
-         } else {
-            if (parentRef) parentRef->onError(SNC::Error::ReadFailed, ec);
-            return;
-         }
+         readFailed(ec);
+         return;
       }
+      readBuffer.commit(length);
       if (parentRef) {
-         parentRef->onReceive({ readBuffer.data(), readBuffer.data() + length });
+         parentRef->metrics.traffic.bytesIn.fetch_add(length, std::memory_order_relaxed);
+         parentRef->metrics.readSize.record(length);
+         parentRef->onReceiveBuffer(readBuffer);
          parentRef->onEvent(SNC::Event::DataReceived);
       }
       readData();
    };
 
-   socket.async_read_some(asio::buffer(readBuffer.data(), readBuffer.size()), readLambda);
+   socket.async_read_some(readBuffer.prepareRead(readChunkSize), readLambda);
+}
+
+void Client::readFailed(const std::error_code& ec) {
+   clientAbort();
+   if (ec == asio::error::eof || ec == asio::error::connection_reset) {
+      if (parentRef) parentRef->reportError(SNC::Error::ConnectionClosed, ec);
+   } else if (ec == asio::error::operation_aborted) {
+      if (parentRef) parentRef->reportError(SNC::Error::Aborted, ec);
+   } else {
+      if (parentRef) parentRef->reportError(SNC::Error::ReadFailed, ec);
+   }
+}
+
+asio::awaitable<asio::error_code> Client::connect(const std::string& host, ushort_16 port) {
+   auto self(shared_from_this());
+   asio::error_code ec;
+   if (HasFlag(state, SNC::Online)) {
+      if (parentRef) parentRef->reportError(SNC::Error::AlreadyConnected, ec);
+      co_return asio::error::already_connected;
+   }
+   AddFlag(state, SNC::Online);
+   AddFlag(state, SNC::Connecting);
+
+   host_ = host;
+   port_ = port;
+   readBuffer.clear();
+
+   resolvedEndpoints = co_await resolver.async_resolve(host_, std::to_string(port_), asio::redirect_error(asio::use_awaitable, ec));
+   if (ec) {
+      if (parentRef) parentRef->reportError(SNC::Error::ResolveFailed, ec);
+      clientAbort();
+      co_return ec;
+   }
+   if (parentRef) {
+      parentRef->onEvent(SNC::Event::Resolved);
+      parentRef->onResolve();
+   }
+
+   connectedEndpoints = co_await asio::async_connect(socket, resolvedEndpoints, asio::redirect_error(asio::use_awaitable, ec));
+   if (ec) {
+      if (parentRef) parentRef->reportError(SNC::Error::ConnectFailed, ec);
+      clientAbort();
+      co_return ec;
+   }
+   RemoveFlag(state, SNC::Connecting);
+
+   if (parentRef) {
+      parentRef->metrics.accepted.fetch_add(1, std::memory_order_relaxed);
+      parentRef->metrics.active.store(1, std::memory_order_relaxed);
+      parentRef->onEvent(SNC::Event::Connected);
+      parentRef->onConnect();
+   }
+   co_return ec;
+}
+
+asio::awaitable<asio::error_code> Client::readSome() {
+   auto self(shared_from_this());
+   asio::error_code ec;
+   std::size_t length = co_await socket.async_read_some(readBuffer.prepareRead(readChunkSize), asio::redirect_error(asio::use_awaitable, ec));
+   if (ec) {
+      readFailed(ec);
+      co_return ec;
+   }
+   readBuffer.commit(length);
+   if (parentRef) {
+      parentRef->metrics.traffic.bytesIn.fetch_add(length, std::memory_order_relaxed);
+      parentRef->metrics.readSize.record(length);
+      parentRef->onEvent(SNC::Event::DataReceived);
+   }
+   co_return ec;
+}
+
+asio::awaitable<asio::error_code> Client::write(SN::SharedBuffer msg) {
+   auto self(shared_from_this());
+   asio::error_code ec;
+   if (!socket.is_open()) {
+      if (parentRef) parentRef->reportError(SNC::Error::ConnectionClosed, ec);
+      co_return asio::error::not_connected;
+   }
+   auto outcome = std::make_shared<std::optional<asio::error_code>>();
+   writeQueue.push(std::move(msg), outcome);
+   if (!writeQueue.isWriting()) {
+      const auto& buffers = writeQueue.prepare();
+      if (parentRef) parentRef->metrics.writeQueueDepth.record(buffers.size());
+      std::size_t length = co_await asio::async_write(socket, buffers, asio::redirect_error(asio::use_awaitable, ec));
+      writeDone(ec, length);
+   }
+   // Queued behind a write in flight, writeDone starts the one carrying msg.
+   while (!*outcome && writeQueue.isWriting()) {
+      writeSignal.expires_at(asio::steady_timer::time_point::max());
+      co_await writeSignal.async_wait(asio::redirect_error(asio::use_awaitable, ec));
+   }
+   co_return outcome->value_or(asio::error_code(asio::error::not_connected));
 }
 
 void Client::clientAbort() {
@@ -127,11 +242,12 @@ void Client::clientAbort() {
       RemoveFlag(state, SNC::Online);
       RemoveFlag(state, SNC::Connecting);
       ec = socket.shutdown(tcp::socket::shutdown_both, ec);
-      if (ec && parentRef) parentRef->onError(SNC::Error::AbortShutdownFailed, ec);
+      if (ec && parentRef) parentRef->reportError(SNC::Error::AbortShutdownFailed, ec);
       ec = socket.close(ec);
-      if (ec && parentRef) parentRef->onError(SNC::Error::AbortCloseFailed, ec);
+      if (ec && parentRef) parentRef->reportError(SNC::Error::AbortCloseFailed, ec);
 
       if (parentRef) {
+         parentRef->metrics.active.store(0, std::memory_order_relaxed);
          parentRef->stopContext();
          parentRef->onDisconnect();
          parentRef->onEvent(SNC::Event::Disconnected);
@@ -177,13 +293,33 @@ void SNC::autoConnect(const std::string& ip, ushort_16 port) {
 }
 
 void SNC::send(const std::vector<ubyte_8>& msg) {
-   clientPtr->send(msg);
+   clientPtr->send(std::vector<ubyte_8>(msg));
+}
+
+void SNC::send(std::vector<ubyte_8>&& msg) {
+   clientPtr->send(std::move(msg));
 }
 
 void SNC::send(const std::string& msg) {
    clientPtr->send(std::vector<ubyte_8>(msg.begin(), msg.end()));
 }
 
+asio::awaitable<asio::error_code> SNC::connect(const std::string& ip, ushort_16 port) {
+   return clientPtr->connect(ip, port);
+}
+
+asio::awaitable<asio::error_code> SNC::readSome() {
+   return clientPtr->readSome();
+}
+
+asio::awaitable<asio::error_code> SNC::write(SharedBuffer msg) {
+   return clientPtr->write(std::move(msg));
+}
+
+StreamBuffer& SNC::getReadBuffer() {
+   return clientPtr->readBuffer;
+}
+
 void SNC::disconnect() {
    clientPtr->disconnect();
 }
@@ -208,9 +344,8 @@ void SNC::joinThread() {
 
 void SNC::stopContext() {
    if (!contextPtr_ || !context_) return;
-
+   // Restarted by startThread, once the thread has left run().
    context_->stop();
-   context_->reset();
 }
 
 asio::io_context& SNC::getContext() {
@@ -233,6 +368,31 @@ const tcp::endpoint& SNC::getCEndpoints() {
    return clientPtr->connectedEndpoints;
 }
 
+NetMetrics::Snapshot SNC::getMetrics() {
+   return metrics.snapshot();
+}
+
+void SNC::recordPacketIn(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point decoded) {
+   auto handled = std::chrono::steady_clock::now();
+   metrics.traffic.packetsIn.fetch_add(1, std::memory_order_relaxed);
+   metrics.decodeTime.record(std::chrono::duration_cast<std::chrono::nanoseconds>(decoded - start).count());
+   metrics.handlerTime.record(std::chrono::duration_cast<std::chrono::nanoseconds>(handled - decoded).count());
+}
+
+void SNC::recordPacketOut() {
+   metrics.traffic.packetsOut.fetch_add(1, std::memory_order_relaxed);
+}
+
+void SNC::reportError(Error err, const asio::error_code& ec) {
+   metrics.errors.add(static_cast<std::size_t>(err));
+   onError(err, ec);
+}
+
+void SNC::onReceiveBuffer(StreamBuffer& buffer) {
+   onReceive({ buffer.begin(), buffer.end() });
+   buffer.consume(buffer.size());
+}
+
 void SNC::onEvent(Event evt) {
    switch (evt) {
    case SNC::Event::Resolved:
@@ -303,76 +463,280 @@ void SNC::printClient(std::string&& clientStr, const std::string& ip, ushort_16
 
 /*CONNECTION*/
 StreamedNetConnection::StreamedNetConnection(asio::io_context& context, StreamedNetServer& serverRef, tcp::socket& accepted) :
-   context_(context), socket(std::move(accepted)), readBuffer(20 * 1024), writeBuffer(20 * 1024), server(serverRef) {
+   context_(context), strand_(asio::make_strand(context)), socket(std::move(accepted)), server(serverRef),
+   bufferPool(serverRef.getBufferPool()), readBuffer(*bufferPool), writeQueue(*bufferPool), writeSignal(strand_), readinessReads(serverRef.getReadinessReads()),
+   lowWatermark(serverRef.getLowWatermark()), highWatermark(serverRef.getHighWatermark()), slowConsumerPolicy(serverRef.getSlowConsumerPolicy()) {
    AddFlag(state, State::Online);
    onConnect();
 }
 
 void StreamedNetConnection::start() {
-   readData();
-   onStart();
+   auto self(shared_from_this());
+   asio::dispatch(strand_, [this, self]() {
+      if (readinessReads && !awaitReads) {
+         ec = socket.non_blocking(true, ec);
+         if (ec) readinessReads = false;
+      }
+      if (!awaitReads) readData();
+      onStart();
+   });
 }
 
 void StreamedNetConnection::disconnect() {
    auto self(shared_from_this());
-   asio::post(context_, [this, self]() {
+   asio::post(strand_, [this, self]() {
       connectionAbort();
    });
 }
 
 void StreamedNetConnection::send(const std::vector<ubyte_8>& msg) {
+   send(std::vector<ubyte_8>(msg));
+}
+
+void StreamedNetConnection::send(std::vector<ubyte_8>&& msg) {
+   send(bufferPool->share(std::move(msg)));
+}
+
+void StreamedNetConnection::send(SharedBuffer msg) {
    auto self(shared_from_this());
-   asio::post(context_, [this, msg, self]() {
-      std::copy(msg.begin(), msg.end(), writeBuffer.begin());
+   std::size_t size = msg->size();
+   std::size_t queued = queuedBytes.load(std::memory_order_relaxed);
+   if (slowConsumerPolicy == SlowConsumerPolicy::DropNewest && queued != 0 && queued + size > highWatermark) {
+      droppedMessages.fetch_add(1, std::memory_order_relaxed);
+      if (!backpressured) {
+         asio::post(strand_, [this, self]() {
+            if (backpressured) return;
+            backpressured = true;
+            onBackpressure();
+         });
+      }
+      return;
+   }
+   queuedBytes.fetch_add(size, std::memory_order_relaxed);
 
-      auto writeLambda = [this, msg, self](std::error_code ec, std::size_t length) {
-         if (ec) {
-            connectionAbort();
-            if (ec == asio::error::eof || ec == asio::error::connection_reset) {
-               onError(Error::ConnectionClosed, ec);
-               return;
-            } else if (ec == asio::error::operation_aborted) {
-               onError(Error::Aborted, ec);
-               return;
-            } else {
-               onError(Error::WriteFailed, ec);
-               return;
-            }
-         }
-         onEvent(Event::DataSent);
-         };
-      if (socket.is_open()) {
-         asio::async_write(socket, asio::buffer(writeBuffer.data(), msg.size()), writeLambda);
-      } else onError(Error::ConnectionClosed, ec);
+   asio::post(strand_, [this, self, msg = std::move(msg)]() mutable {
+      if (!socket.is_open()) {
+         queuedBytes.fetch_sub(msg->size(), std::memory_order_relaxed);
+         reportError(Error::ConnectionClosed, ec);
+         return;
+      }
+      writeQueue.push(std::move(msg));
+      checkBackpressure();
+      if (HasFlag(state, State::Online) && !writeQueue.isWriting()) writeData();
    });
 }
 
+void StreamedNetConnection::send(std::vector<SharedBuffer> msgs) {
+   if (msgs.empty()) return;
+   auto self(shared_from_this());
+   std::size_t size = 0;
+   for (auto& msg : msgs) size += msg->size();
+   std::size_t queued = queuedBytes.load(std::memory_order_relaxed);
+   if (slowConsumerPolicy == SlowConsumerPolicy::DropNewest && queued != 0 && queued + size > highWatermark) {
+      droppedMessages.fetch_add(msgs.size(), std::memory_order_relaxed);
+      if (!backpressured) {
+         asio::post(strand_, [this, self]() {
+            if (backpressured) return;
+            backpressured = true;
+            onBackpressure();
+         });
+      }
+      return;
+   }
+   queuedBytes.fetch_add(size, std::memory_order_relaxed);
+
+   asio::post(strand_, [this, self, size, msgs = std::move(msgs)]() mutable {
+      if (!socket.is_open()) {
+         queuedBytes.fetch_sub(size, std::memory_order_relaxed);
+         reportError(Error::ConnectionClosed, ec);
+         return;
+      }
+      for (auto& msg : msgs) writeQueue.push(std::move(msg));
+      checkBackpressure();
+      if (HasFlag(state, State::Online) && !writeQueue.isWriting()) writeData();
+   });
+}
+
+void StreamedNetConnection::writeData() {
+   auto self(shared_from_this());
+   auto writeLambda = [this, self](std::error_code ec, std::size_t length) {
+      writeDone(ec, length);
+      };
+
+   const auto& buffers = writeQueue.prepare();
+   server.metrics.writeQueueDepth.record(buffers.size());
+   asio::async_write(socket, buffers, asio::bind_executor(strand_, writeLambda));
+}
+
+void StreamedNetConnection::writeDone(const std::error_code& ec, std::size_t length) {
+   queuedBytes.fetch_sub(writeQueue.complete(ec), std::memory_order_relaxed);
+   writeSignal.cancel();
+   if (ec) {
+      queuedBytes.fetch_sub(writeQueue.clear(), std::memory_order_relaxed);
+      connectionAbort();
+      if (ec == asio::error::eof || ec == asio::error::connection_reset) {
+         reportError(Error::ConnectionClosed, ec);
+      } else if (ec == asio::error::operation_aborted) {
+         reportError(Error::Aborted, ec);
+      } else {
+         reportError(Error::WriteFailed, ec);
+      }
+      return;
+   }
+   traffic.bytesOut.fetch_add(length, std::memory_order_relaxed);
+   server.metrics.traffic.bytesOut.fetch_add(length, std::memory_order_relaxed);
+   onEvent(Event::DataSent);
+   if (backpressured && queuedBytes.load(std::memory_order_relaxed) <= lowWatermark) {
+      backpressured = false;
+      onWritable();
+   }
+   if (writeQueue.hasPending()) writeData();
+}
+
+asio::awaitable<asio::error_code> StreamedNetConnection::readSome() {
+   auto self(shared_from_this());
+   asio::error_code ec;
+   std::size_t length = co_await socket.async_read_some(readBuffer.prepareRead(readChunkSize), asio::redirect_error(asio::use_awaitable, ec));
+   if (ec) {
+      readFailed(ec);
+      co_return ec;
+   }
+   readBuffer.commit(length);
+   recordRead(length);
+   onEvent(Event::DataReceived);
+   co_return ec;
+}
+
+asio::awaitable<asio::error_code> StreamedNetConnection::write(SharedBuffer msg) {
+   auto self(shared_from_this());
+   asio::error_code ec;
+   if (!socket.is_open()) {
+      reportError(Error::ConnectionClosed, ec);
+      co_return asio::error::not_connected;
+   }
+   auto outcome = std::make_shared<std::optional<asio::error_code>>();
+   queuedBytes.fetch_add(msg->size(), std::memory_order_relaxed);
+   writeQueue.push(std::move(msg), outcome);
+   checkBackpressure();
+   if (HasFlag(state, State::Online) && !writeQueue.isWriting() && writeQueue.hasPending()) {
+      const auto& buffers = writeQueue.prepare();
+      server.metrics.writeQueueDepth.record(buffers.size());
+      std::size_t length = co_await asio::async_write(socket, buffers, asio::redirect_error(asio::use_awaitable, ec));
+      writeDone(ec, length);
+   }
+   // Queued behind a write in flight, writeDone starts the one carrying msg.
+   while (!*outcome && writeQueue.isWriting()) {
+      writeSignal.expires_at(asio::steady_timer::time_point::max());
+      co_await writeSignal.async_wait(asio::redirect_error(asio::use_awaitable, ec));
+   }
+   co_return outcome->value_or(asio::error_code(asio::error::not_connected));
+}
+
+StreamBuffer& StreamedNetConnection::getReadBuffer() {
+   return readBuffer;
+}
+
+void StreamedNetConnection::checkBackpressure() {
+   std::size_t queued = queuedBytes.load(std::memory_order_relaxed);
+   if (queued <= highWatermark) return;
+
+   switch (slowConsumerPolicy) {
+   case SlowConsumerPolicy::DropOldest: {
+      std::size_t dropped = 0;
+      queuedBytes.fetch_sub(writeQueue.dropOldest(queued - highWatermark, dropped), std::memory_order_relaxed);
+      droppedMessages.fetch_add(dropped, std::memory_order_relaxed);
+      break;
+   }
+   case SlowConsumerPolicy::Disconnect:
+      if (HasFlag(state, State::Online)) {
+         reportError(Error::SlowConsumer, ec);
+         queuedBytes.fetch_sub(writeQueue.clear(), std::memory_order_relaxed);
+         connectionAbort();
+      }
+      return;
+   default:
+      break;
+   }
+
+   if (!backpressured) {
+      backpressured = true;
+      onBackpressure();
+   }
+}
+
 void StreamedNetConnection::send(const std::string& msg) {
    send(std::vector<ubyte_8>(msg.begin(), msg.end()));
 }
 
 void StreamedNetConnection::readData() {
    auto self(shared_from_this());
-   auto readLambda = [this, self](std::error_code ec, std::size_t length) {
-      if (ec) {
-         connectionAbort();
-         if (ec == asio::error::eof || ec == asio::error::connection_reset) {
-            onError(Error::ConnectionClosed, ec);
-            return;
-         } else if (ec == asio::error::operation_aborted) {
-            onError(Error::Aborted, ec);
-            return;
-         } else {
-            onError(Error::ReadFailed, ec);
+   if (readinessReads) {
+      auto waitLambda = [this, self](std::error_code ec) {
+         if (ec) {
+            readFailed(ec);
             return;
          }
+         readAvailable();
+         };
+
+      socket.async_wait(tcp::socket::wait_read, asio::bind_executor(strand_, waitLambda));
+      return;
+   }
+
+   auto readLambda = [this, self](std::error_code ec, std::size_t length) {
+      if (ec) {
+         readFailed(ec);
+         return;
       }
-      onReceive({ readBuffer.data(), readBuffer.data() + length });
+      readBuffer.commit(length);
+      recordRead(length);
+      onReceiveBuffer(readBuffer);
       onEvent(Event::DataReceived);
       readData();
       };
 
-   socket.async_read_some(asio::buffer(readBuffer.data(), readBuffer.size()), readLambda);
+   socket.async_read_some(readBuffer.prepareRead(readChunkSize), asio::bind_executor(strand_, readLambda));
+}
+
+void StreamedNetConnection::readAvailable() {
+   // Shared by every connection of this thread, it only holds data during one call.
+   thread_local StreamBuffer threadBuffer;
+   StreamBuffer& target = readBuffer.empty() ? threadBuffer : readBuffer;
+
+   std::error_code ec;
+   std::size_t length = socket.read_some(target.prepareRead(readChunkSize), ec);
+   if (ec == asio::error::would_block || ec == asio::error::try_again) {
+      readData();
+      return;
+   }
+   if (ec) {
+      readFailed(ec);
+      return;
+   }
+   target.commit(length);
+   recordRead(length);
+   onReceiveBuffer(target);
+   onEvent(Event::DataReceived);
+
+   if (&target == &threadBuffer && !threadBuffer.empty()) {
+      asio::mutable_buffer space = readBuffer.prepare(threadBuffer.size());
+      std::memcpy(space.data(), threadBuffer.data(), threadBuffer.size());
+      readBuffer.commit(threadBuffer.size());
+   }
+   threadBuffer.clear();
+   readBuffer.release();
+   readData();
+}
+
+void StreamedNetConnection::readFailed(const std::error_code& ec) {
+   connectionAbort();
+   if (ec == asio::error::eof || ec == asio::error::connection_reset) {
+      reportError(Error::ConnectionClosed, ec);
+   } else if (ec == asio::error::operation_aborted) {
+      reportError(Error::Aborted, ec);
+   } else {
+      reportError(Error::ReadFailed, ec);
+   }
 }
 
 void StreamedNetConnection::connectionAbort() {
@@ -388,10 +752,67 @@ asio::io_context& StreamedNetConnection::getContext() {
    return context_;
 }
 
+asio::strand<asio::io_context::executor_type>& StreamedNetConnection::getStrand() {
+   return strand_;
+}
+
 StreamedNetServer& StreamedNetConnection::getServer() {
    return server;
 }
 
+ConnectionId StreamedNetConnection::getId() {
+   return id;
+}
+
+BufferPool& StreamedNetConnection::getBufferPool() {
+   return *bufferPool;
+}
+
+std::size_t StreamedNetConnection::getQueuedBytes() {
+   return queuedBytes.load(std::memory_order_relaxed);
+}
+
+std::size_t StreamedNetConnection::getDroppedMessages() {
+   return droppedMessages.load(std::memory_order_relaxed);
+}
+
+bool StreamedNetConnection::isBackpressured() {
+   return backpressured;
+}
+
+TrafficCounters::Snapshot StreamedNetConnection::getTraffic() {
+   return traffic.snapshot();
+}
+
+void StreamedNetConnection::recordRead(std::size_t length) {
+   traffic.bytesIn.fetch_add(length, std::memory_order_relaxed);
+   server.metrics.traffic.bytesIn.fetch_add(length, std::memory_order_relaxed);
+   server.metrics.readSize.record(length);
+}
+
+void StreamedNetConnection::recordPacketIn(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point decoded) {
+   auto handled = std::chrono::steady_clock::now();
+   traffic.packetsIn.fetch_add(1, std::memory_order_relaxed);
+   server.metrics.traffic.packetsIn.fetch_add(1, std::memory_order_relaxed);
+   server.metrics.decodeTime.record(std::chrono::duration_cast<std::chrono::nanoseconds>(decoded - start).count());
+   server.metrics.handlerTime.record(std::chrono::duration_cast<std::chrono::nanoseconds>(handled - decoded).count());
+}
+
+void StreamedNetConnection::recordPacketOut() {
+   traffic.packetsOut.fetch_add(1, std::memory_order_relaxed);
+   server.metrics.traffic.packetsOut.fetch_add(1, std::memory_order_relaxed);
+}
+
+void StreamedNetConnection::reportError(Error err, const asio::error_code& ec) {
+   server.connectionErrors.add(static_cast<std::size_t>(err));
+   onError(err, ec);
+}
+
+void StreamedNetConnection::onReceiveBuffer(StreamBuffer& buffer) {
+   onReceive({ buffer.begin(), buffer.end() });
+   buffer.consume(buffer.size());
+}
+
 void StreamedNetConnection::onEvent(Event evt) {
    switch (evt) {
    case Event::DataReceived:
@@ -419,25 +840,29 @@ void StreamedNetConnection::onError(Error err, const asio::error_code& ec) {
    case Error::ReadFailed:
       std::cerr << "read failed\n";
       break;
+   case Error::SlowConsumer:
+      std::cerr << "slow consumer disconnected\n";
+      break;
    default:
       break;
    }
 }
 
 /*SERVER*/
-Server::Server(asio::io_context& context, StreamedNetServer& parent) : context_(context), parentRef(&parent) {}
+Server::Server(asio::io_context& context, StreamedNetServer& parent) : parentRef(&parent), context_(context), strand_(asio::make_strand(context)) {}
 
 void Server::start(ushort_16 port) {
    if (HasFlag(state, SNS::Online)) {
-      if (parentRef) parentRef->onError(SNS::Error::AlreadyStarted, ec);
+      if (parentRef) parentRef->reportError(SNS::Error::AlreadyStarted, ec);
       return;
    }
-   AddFlag(state, SNS::Online);
    if (parentRef) parentRef->joinThread();
-   connections.clear();
+   AddFlag(state, SNS::Online);
+   // Left over if the pool stopped before their disconnect ran, no thread runs them anymore.
+   for (auto& connection : *connections.snapshot()) removeConnection(connection);
    port_ = port;
 
-   acceptor.emplace(context_, tcp::endpoint(tcp::v4(), port));
+   acceptor.emplace(strand_, tcp::endpoint(tcp::v4(), port));
    if (parentRef) {
       parentRef->onStart();
       parentRef->onEvent(SNS::Event::OnStart);
@@ -447,9 +872,11 @@ void Server::start(ushort_16 port) {
 }
 
 void Server::close() {
-   asio::post(context_, [this]() {
-      serverAbort();
-      });
+   if (HasFlag(state, SNS::Online)) {
+      asio::post(strand_, [this]() {
+         serverAbort();
+         });
+   }
    if (parentRef) parentRef->joinThread();
 }
 
@@ -459,7 +886,7 @@ void Server::acceptClients() {
 
    auto aceptLambda = [&](const asio::error_code& ec) {
       if (ec) {
-         if (parentRef) parentRef->onError(SNS::Error::AcceptFailed, ec);
+         if (parentRef) parentRef->reportError(SNS::Error::AcceptFailed, ec);
          serverAbort();
          return;
       } else {
@@ -468,8 +895,10 @@ void Server::acceptClients() {
             return;
          }
          std::shared_ptr<StreamedNetConnection> connection = parentRef->onAccept(*pendingSocket);
+         connection->id = connections.add(connection);
+         parentRef->metrics.accepted.fetch_add(1, std::memory_order_relaxed);
+         parentRef->metrics.active.fetch_add(1, std::memory_order_relaxed);
          connection->start();
-         connections.emplace_back(std::move(connection));
       }
       acceptClients();
       };
@@ -482,28 +911,15 @@ void Server::serverAbort() {
       RemoveFlag(state, SNS::Online);
 
       ec = acceptor->cancel(ec);
-      if (ec && parentRef) parentRef->onError(SNS::Error::AcceptorAbortCancelFailed, ec);
+      if (ec && parentRef) parentRef->reportError(SNS::Error::AcceptorAbortCancelFailed, ec);
 
       ec = acceptor->close(ec);
-      if (ec && parentRef) parentRef->onError(SNS::Error::AcceptorAbortCloseFailed, ec);
-
-      auto removeLambda = [&](std::shared_ptr<StreamedNetConnection>& connection) {
-         tcp::socket& socket = connection->socket;
-         if (socket.is_open()) {
-            ec = socket.shutdown(tcp::socket::shutdown_both, ec);
-            if (ec && parentRef) parentRef->onError(SNS::Error::AbortShutdownFailed, ec);
-            ec = socket.close(ec);
-            if (ec && parentRef) parentRef->onError(SNS::Error::AbortCloseFailed, ec);
-         }
-         return true;
-         };
+      if (ec && parentRef) parentRef->reportError(SNS::Error::AcceptorAbortCloseFailed, ec);
 
-      connections.erase(
-         std::remove_if(connections.begin(), connections.end(), removeLambda),
-         connections.end()
-      );
+      // Sockets belong to their connection's strand, each one closes itself and leaves
+      // the registry through removeConnection, the pool threads return once they are done.
+      for (auto& connection : *connections.snapshot()) connection->disconnect();
       if (parentRef) {
-         parentRef->stopContext();
          parentRef->onAbort();
          parentRef->onEvent(SNS::Event::Aborted);
       }
@@ -511,27 +927,26 @@ void Server::serverAbort() {
 }
 
 void Server::removeConnection(std::shared_ptr<StreamedNetConnection> connection) {
-   auto it = std::find(connections.begin(), connections.end(), connection);
-   if (it != connections.end()) {
+   if (connections.remove(connection->id)) {
+      if (parentRef) parentRef->metrics.active.fetch_sub(1, std::memory_order_relaxed);
+
       std::error_code ec;
       if (parentRef) parentRef->onDisconnect(connection);
 
       ec = connection->socket.shutdown(tcp::socket::shutdown_both, ec);
-      if (ec && parentRef) parentRef->onError(SNS::Error::AbortShutdownFailed, ec);
+      if (ec && parentRef) parentRef->reportError(SNS::Error::AbortShutdownFailed, ec);
       ec = connection->socket.close(ec);
-      if (ec && parentRef) parentRef->onError(SNS::Error::AbortCloseFailed, ec);
-
-      connections.erase(it);
+      if (ec && parentRef) parentRef->reportError(SNS::Error::AbortCloseFailed, ec);
    }
 }
 
 /*SERVER_WRAPPER*/
-SNS::StreamedNetServer() : contextPtr_(std::make_unique<asio::io_context>()), context_(contextPtr_.get()),
-serverPtr(std::make_shared<Server>(*context_, *this)) {
+SNS::StreamedNetServer() : bufferPool(std::shared_ptr<BufferPool>(), &BufferPool::defaultPool()),
+contextPtr_(std::make_unique<asio::io_context>()), context_(contextPtr_.get()), serverPtr(std::make_shared<Server>(*context_, *this)) {
 }
 
-SNS::StreamedNetServer(asio::io_context& context) : contextPtr_(nullptr), context_(&context),
-serverPtr(std::make_shared<Server>(*context_, *this)) {
+SNS::StreamedNetServer(asio::io_context& context) : bufferPool(std::shared_ptr<BufferPool>(), &BufferPool::defaultPool()),
+contextPtr_(nullptr), context_(&context), serverPtr(std::make_shared<Server>(*context_, *this)) {
 }
 
 SNS::~StreamedNetServer() {
@@ -539,15 +954,28 @@ SNS::~StreamedNetServer() {
 }
 
 SN::StreamedNetServer::StreamedNetServer(StreamedNetServer&& other) noexcept : 
-thr(std::move(other.thr)), contextPtr_(std::move(other.contextPtr_)), context_(other.context_), serverPtr(std::move(other.serverPtr)) {
+threads(std::move(other.threads)), workGuard(std::move(other.workGuard)), threadCount(other.threadCount), bufferPool(std::move(other.bufferPool)), readinessReads(other.readinessReads),
+lowWatermark(other.lowWatermark), highWatermark(other.highWatermark), slowConsumerPolicy(other.slowConsumerPolicy), contextPtr_(std::move(other.contextPtr_)), context_(other.context_), serverPtr(std::move(other.serverPtr)) {
    other.context_ = nullptr;
 }
 
 StreamedNetServer& SN::StreamedNetServer::operator=(StreamedNetServer&& other) noexcept {
    if (this != &other) {
-      if (thr.joinable()) thr.join();  
+      workGuard.reset();
+      stopContext();
+      for (auto& thr : threads) {
+         if (thr.joinable()) thr.join();
+      }
 
-      thr = std::move(other.thr);
+      threads = std::move(other.threads);
+      if (other.workGuard) workGuard.emplace(std::move(*other.workGuard));
+      other.workGuard.reset();
+      threadCount = other.threadCount;
+      bufferPool = std::move(other.bufferPool);
+      readinessReads = other.readinessReads;
+      lowWatermark = other.lowWatermark;
+      highWatermark = other.highWatermark;
+      slowConsumerPolicy = other.slowConsumerPolicy;
       contextPtr_ = std::move(other.contextPtr_);
       context_ = other.context_;
       serverPtr = std::move(other.serverPtr);
@@ -568,26 +996,68 @@ void SNS::close() {
 void SNS::startThread() {
    if (!contextPtr_ || !context_) return;
 
-   thr = std::thread([this]() {
-      context_->reset();
-      context_->run();
-      });
+   context_->reset();
+   workGuard.emplace(context_->get_executor());
+   threads.clear();
+   for (std::size_t i = 0; i < threadCount; i++) {
+      threads.emplace_back([this]() {
+         context_->run();
+         });
+   }
 }
 
 void SNS::joinThread() {
    if (!contextPtr_ || !context_) return;
-   if (!thr.joinable()) return;
+   // A pool thread cannot wait for the pool, it is one of them.
+   for (auto& thr : threads) {
+      if (std::this_thread::get_id() == thr.get_id()) return;
+   }
+   if (threads.empty()) return;
+
+   // The pool finishes the abort and the last handlers of the closed sockets, then is
+   // stopped: timers or coroutines left on the context would keep it running for good.
+   workGuard.reset();
+   auto deadline = std::chrono::steady_clock::now() + closeTimeout;
+   while ((isOnline() || getConnectionCount() != 0) && std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+   }
+   // Queued behind the completions of the sockets closed so far.
+   auto flushed = std::make_shared<std::promise<void>>();
+   asio::post(*context_, [flushed]() { flushed->set_value(); });
+   flushed->get_future().wait_until(deadline);
    context_->stop();
 
-   if (std::this_thread::get_id() == thr.get_id()) return;
-   thr.join();
+   for (auto& thr : threads) {
+      if (thr.joinable()) thr.join();
+   }
+   threads.clear();
+}
+
+void SNS::setThreadCount(std::size_t count) {
+   threadCount = std::max<std::size_t>(count, 1);
+}
+
+void SNS::setBufferPool(std::shared_ptr<BufferPool> pool) {
+   if (pool) bufferPool = std::move(pool);
+}
+
+void SNS::setReadinessReads(bool enabled) {
+   readinessReads = enabled;
+}
+
+void SNS::setWriteWatermarks(std::size_t low, std::size_t high) {
+   highWatermark = high;
+   lowWatermark = std::min(low, high);
+}
+
+void SNS::setSlowConsumerPolicy(StreamedNetConnection::SlowConsumerPolicy policy) {
+   slowConsumerPolicy = policy;
 }
 
 void SNS::stopContext() {
    if (!contextPtr_ || !context_) return;
-
+   // Restarted by startThread, once no thread is left in run().
    context_->stop();
-   context_->reset();
 }
 
 asio::io_context& SNS::getContext() {
@@ -598,9 +1068,79 @@ ushort_16 SNS::getPort() {
    return serverPtr->port_;
 }
 
-std::vector<std::shared_ptr<SN::StreamedNetConnection>> SN::StreamedNetServer::getConnections() {
-   std::vector<std::shared_ptr<SN::StreamedNetConnection>> copy = serverPtr->connections;
-   return copy;
+bool SNS::isOnline() {
+   return HasFlag(serverPtr->state, SNS::Online);
+}
+
+std::size_t SNS::getThreadCount() {
+   return threadCount;
+}
+
+std::shared_ptr<BufferPool> SNS::getBufferPool() {
+   return bufferPool;
+}
+
+bool SNS::getReadinessReads() {
+   return readinessReads;
+}
+
+std::size_t SNS::getLowWatermark() {
+   return lowWatermark;
+}
+
+std::size_t SNS::getHighWatermark() {
+   return highWatermark;
+}
+
+StreamedNetConnection::SlowConsumerPolicy SNS::getSlowConsumerPolicy() {
+   return slowConsumerPolicy;
+}
+
+ConnectionSnapshot SNS::getConnections() {
+   return serverPtr->connections.snapshot();
+}
+
+std::shared_ptr<StreamedNetConnection> SNS::getConnection(ConnectionId id) {
+   return serverPtr->connections.get(id);
+}
+
+std::size_t SNS::getConnectionCount() {
+   return serverPtr->connections.size();
+}
+
+NetMetrics::Snapshot SNS::getMetrics() {
+   return metrics.snapshot();
+}
+
+std::array<std::uint64_t, ErrorCounters::maxErrors> SNS::getConnectionErrors() {
+   return connectionErrors.snapshot();
+}
+
+std::string SNS::getMetricsText() {
+   constexpr std::string_view serverErrors[] = {
+      "AlreadyStarted", "AcceptFailed", "AcceptorAbortCancelFailed", "AcceptorAbortCloseFailed", "AbortShutdownFailed", "AbortCloseFailed"
+   };
+   constexpr std::string_view connErrors[] = {
+      "ConnectionClosed", "Aborted", "WriteFailed", "ReadFailed", "SlowConsumer"
+   };
+   constexpr std::string_view prefix = "sn_server_";
+
+   std::string out;
+   NetMetrics::appendPrometheus(out, prefix, metrics.snapshot(), serverErrors);
+   NetMetrics::appendErrors(out, prefix, "connection_errors_total", connectionErrors.snapshot(), connErrors);
+
+   BufferPool::Stats pool = bufferPool->getStats();
+   NetMetrics::appendValue(out, prefix, "pool_acquired_total", "counter", pool.acquired);
+   NetMetrics::appendValue(out, prefix, "pool_reused_total", "counter", pool.reused);
+   NetMetrics::appendValue(out, prefix, "pool_allocated_total", "counter", pool.allocated);
+   NetMetrics::appendValue(out, prefix, "pool_dropped_total", "counter", pool.dropped);
+   NetMetrics::appendValue(out, prefix, "pool_cached_bytes", "gauge", pool.cachedBytes);
+   return out;
+}
+
+void SNS::reportError(Error err, const asio::error_code& ec) {
+   metrics.errors.add(static_cast<std::size_t>(err));
+   onError(err, ec);
 }
 
 std::shared_ptr<StreamedNetConnection> SNS::onAccept(tcp::socket& socket) {
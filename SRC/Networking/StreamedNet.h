@@ -1,7 +1,11 @@
 #ifndef NETWORK_STREAMED_NET_H
 #define NETWORK_STREAMED_NET_H
+#include <chrono>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <thread>
+#include <vector>
 
 #ifdef _WIN32
    #undef WINAPI_FAMILY
@@ -12,6 +16,12 @@
 #include <asio/ts/buffer.hpp>
 #include <asio/ts/internet.hpp>
 
+#include "BufferPool.h"
+#include "ConnectionRegistry.h"
+#include "NetMetrics.h"
+#include "StreamBuffer.h"
+#include "WriteQueue.h"
+
 #define FlagDef(ID) (1LL << ((ID)-1))
 #define HasFlag(flags, flag) (((flags) & (flag)) != 0)
 #define AddFlag(flags, flag) ((flags) |= (flag))
@@ -67,8 +77,21 @@ namespace SN {
 
       void autoConnect(const std::string& ip, ushort_16 port);
       void send(const std::vector<ubyte_8>& msg);
+      void send(std::vector<ubyte_8>&& msg);
       void send(const std::string& msg);
       void disconnect();
+
+      // Coroutine API, await it on getContext(). connect works like autoConnect but starts no
+      // read loop and no thread: data only arrives through readSome(), and whoever spawned the
+      // coroutine runs the context (startThread() for the client's own one).
+      asio::awaitable<asio::error_code> connect(const std::string& ip, ushort_16 port);
+      // Appends at least one byte to getReadBuffer().
+      asio::awaitable<asio::error_code> readSome();
+      // Resumes once msg is written, also when it is queued behind a write in flight, and
+      // gives that write's error. operation_aborted if msg was cleared by a failed write.
+      asio::awaitable<asio::error_code> write(SharedBuffer msg);
+      StreamBuffer& getReadBuffer();
+
       void startThread();
       void joinThread();
       void stopContext();
@@ -78,6 +101,7 @@ namespace SN {
       const std::string getIp();
       tcp::resolver::results_type& getREndpoints();
       const tcp::endpoint& getCEndpoints();
+      NetMetrics::Snapshot getMetrics();
 
       static void printClient(std::string&& clientStr, const std::string& ip = "localhost", ushort_16 port = 0, bool wPort = false);
       friend class SNImpl::Client;
@@ -87,13 +111,21 @@ namespace SN {
       virtual void onResolve() {}
       virtual void onDisconnect() {}
       virtual void onReceive(const std::vector<ubyte_8>& data) {}
+      virtual void onReceiveBuffer(StreamBuffer& buffer);
       virtual void onEvent(Event evt);
       virtual void onError(Error err, const asio::error_code& ec);
 
+      // Called by packet layers once per complete frame: start is before parsing, decoded before the callback.
+      void recordPacketIn(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point decoded);
+      void recordPacketOut();
+
       std::thread thr;
 
    private:
+      void reportError(Error err, const asio::error_code& ec);
+
       std::unique_ptr<asio::io_context> contextPtr_;
+      NetMetrics metrics;
 
    protected:
       asio::io_context* context_;
@@ -116,17 +148,44 @@ namespace SN {
          ConnectionClosed,
          Aborted,
          WriteFailed,
-         ReadFailed
+         ReadFailed,
+         SlowConsumer
+      };
+      // What happens to sends once more than the high watermark is queued.
+      enum class SlowConsumerPolicy {
+         None,
+         DropOldest,
+         DropNewest,
+         Disconnect
       };
 
       StreamedNetConnection(asio::io_context& context, StreamedNetServer& serverRef, tcp::socket& accepted);
       void start();
       void send(const std::vector<ubyte_8>& msg);
+      void send(std::vector<ubyte_8>&& msg);
+      void send(SharedBuffer msg);
+      // Queued together, so they go out in one gathered write.
+      void send(std::vector<SharedBuffer> msgs);
       void send(const std::string& msg);
       void disconnect();
 
+      // Coroutine API, await it on getStrand(); see StreamedNetClient::connect.
+      // readSome appends at least one byte to getReadBuffer(), only use it with awaitReads set.
+      asio::awaitable<asio::error_code> readSome();
+      // Like StreamedNetClient::write, no_buffer_space if DropOldest dropped msg.
+      asio::awaitable<asio::error_code> write(SharedBuffer msg);
+      StreamBuffer& getReadBuffer();
+
       asio::io_context& getContext();
+      asio::strand<asio::io_context::executor_type>& getStrand();
       StreamedNetServer& getServer();
+      // Stable while the connection is registered with its server, see StreamedNetServer::getConnection.
+      ConnectionId getId();
+      BufferPool& getBufferPool();
+      std::size_t getQueuedBytes();
+      std::size_t getDroppedMessages();
+      bool isBackpressured();
+      TrafficCounters::Snapshot getTraffic();
 
       std::atomic<ubyte_8> state = State::Offline;
       friend class StreamedNetServer;
@@ -137,22 +196,57 @@ namespace SN {
       virtual void onStart() {}
       virtual void onDisconnect() {}
       virtual void onReceive(const std::vector<ubyte_8>& data) {}
+      virtual void onReceiveBuffer(StreamBuffer& buffer);
+      virtual void onBackpressure() {}
+      virtual void onWritable() {}
       virtual void onEvent(Event evt);
       virtual void onError(Error err, const asio::error_code& ec);
 
+      void recordPacketIn(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point decoded);
+      void recordPacketOut();
+
       asio::io_context& context_;
+      asio::strand<asio::io_context::executor_type> strand_;
       asio::error_code ec;
 
    private:
       void readData();
+      void readAvailable();
+      void readFailed(const std::error_code& ec);
+      void recordRead(std::size_t length);
+      void writeData();
+      void writeDone(const std::error_code& ec, std::size_t length);
+      void checkBackpressure();
       void connectionAbort();
+      void reportError(Error err, const asio::error_code& ec);
       tcp::socket socket;
       StreamedNetServer& server;
+      ConnectionId id = invalidConnectionId;
+
+      std::shared_ptr<BufferPool> bufferPool;
+      StreamBuffer readBuffer;
+      WriteQueue writeQueue;
+      // Cancelled by writeDone to wake the coroutine writes queued behind it.
+      asio::steady_timer writeSignal;
+      std::atomic<std::size_t> queuedBytes = 0;
+      std::atomic<std::size_t> droppedMessages = 0;
+      std::atomic<bool> backpressured = false;
+      TrafficCounters traffic;
 
-      std::vector<ubyte_8> readBuffer;
-      std::vector<ubyte_8> writeBuffer;
+   protected:
+      // Wait for readability and read into a per-thread buffer, so idle connections hold no receive buffer.
+      bool readinessReads = false;
+      // No read loop is started, the connection is read by awaiting readSome(). Set it before start().
+      bool awaitReads = false;
+      // Taken from the server on construction, change them before start().
+      std::size_t lowWatermark;
+      std::size_t highWatermark;
+      SlowConsumerPolicy slowConsumerPolicy;
    };
 
+   // Shared, read-only list of a server's connections at one point in time.
+   using ConnectionSnapshot = ConnectionRegistry<StreamedNetConnection>::Snapshot;
+
    class StreamedNetServer {
    public:
       enum State {
@@ -187,10 +281,29 @@ namespace SN {
       void startThread();
       void joinThread();
       void stopContext();
+      void setThreadCount(std::size_t count);
+      void setBufferPool(std::shared_ptr<BufferPool> pool);
+      void setReadinessReads(bool enabled);
+      void setWriteWatermarks(std::size_t low, std::size_t high);
+      void setSlowConsumerPolicy(StreamedNetConnection::SlowConsumerPolicy policy);
 
       asio::io_context& getContext();
       ushort_16 getPort();
-      std::vector<std::shared_ptr<SN::StreamedNetConnection>> getConnections();
+      bool isOnline();
+      std::size_t getThreadCount();
+      std::shared_ptr<BufferPool> getBufferPool();
+      bool getReadinessReads();
+      std::size_t getLowWatermark();
+      std::size_t getHighWatermark();
+      StreamedNetConnection::SlowConsumerPolicy getSlowConsumerPolicy();
+      // Cheap to call per message, the list is only rebuilt after connections came or went.
+      ConnectionSnapshot getConnections();
+      std::shared_ptr<StreamedNetConnection> getConnection(ConnectionId id);
+      std::size_t getConnectionCount();
+      NetMetrics::Snapshot getMetrics();
+      std::array<std::uint64_t, ErrorCounters::maxErrors> getConnectionErrors();
+      // Server, connection and buffer pool metrics in the Prometheus text format.
+      std::string getMetricsText();
 
       static void printServer(std::string&& serverStr, ushort_16 port = 0, bool wPort = false);
       friend class SNImpl::Server;
@@ -206,12 +319,23 @@ namespace SN {
 
    private:
       SNImpl::Server& getImpl();
+      void reportError(Error err, const asio::error_code& ec);
 
    protected:
-      std::thread thr;
+      std::vector<std::thread> threads;
+      // Keeps the pool running until joinThread(), also while the server has no work queued.
+      std::optional<asio::executor_work_guard<asio::io_context::executor_type>> workGuard;
+      std::size_t threadCount = 1;
+      std::shared_ptr<BufferPool> bufferPool;
+      bool readinessReads = false;
+      std::size_t lowWatermark = 256 * 1024;
+      std::size_t highWatermark = 1024 * 1024;
+      StreamedNetConnection::SlowConsumerPolicy slowConsumerPolicy = StreamedNetConnection::SlowConsumerPolicy::None;
 
    private:
       std::unique_ptr<asio::io_context> contextPtr_;
+      NetMetrics metrics;
+      ErrorCounters connectionErrors;
 
    protected:
       asio::io_context* context_;
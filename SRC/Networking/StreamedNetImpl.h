@@ -16,10 +16,17 @@ namespace SNImpl {
 
       void autoConnect(const std::string& host, ushort_16 port);
       
-      void send(const std::vector<ubyte_8>& msg);
+      void send(std::vector<ubyte_8>&& msg);
       void disconnect();
 
+      asio::awaitable<asio::error_code> connect(const std::string& host, ushort_16 port);
+      asio::awaitable<asio::error_code> readSome();
+      asio::awaitable<asio::error_code> write(SN::SharedBuffer msg);
+
       void readData();
+      void readFailed(const std::error_code& ec);
+      void writeData();
+      void writeDone(const std::error_code& ec, std::size_t length);
       void clientAbort();
 
       SN::StreamedNetClient* parentRef;
@@ -35,8 +42,9 @@ namespace SNImpl {
       tcp::endpoint connectedEndpoints;
       tcp::resolver::results_type resolvedEndpoints;
 
-      std::vector<ubyte_8> readBuffer;
-      std::vector<ubyte_8> writeBuffer;
+      SN::StreamBuffer readBuffer;
+      SN::WriteQueue writeQueue;
+      asio::steady_timer writeSignal;
    };
 
    class Server : std::enable_shared_from_this<Server> {
@@ -52,13 +60,14 @@ namespace SNImpl {
 
       SN::StreamedNetServer* parentRef;
       asio::io_context& context_;
+      asio::strand<asio::io_context::executor_type> strand_;
       asio::error_code ec;
       std::atomic<ubyte_8> state = SN::StreamedNetServer::Offline;
       std::optional<tcp::acceptor> acceptor;
       std::optional<tcp::socket> pendingSocket;
       ushort_16 port_ = 0;
 
-      std::vector<std::shared_ptr<SN::StreamedNetConnection>> connections;
+      SN::ConnectionRegistry<SN::StreamedNetConnection> connections;
    };
 }
 
@@ -0,0 +1,99 @@
+#ifndef NETWORK_WRITE_QUEUE_H
+#define NETWORK_WRITE_QUEUE_H
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "../Util/AsioInclude.h"
+#include "BufferPool.h"
+
+namespace SN {
+   // Outbound messages of one socket. Everything queued while a write is in
+   // flight is handed to the next async_write as a single buffer sequence.
+   class WriteQueue {
+   public:
+      // Set once the message it was pushed with left the queue: the result of its write,
+      // operation_aborted if it was cleared or no_buffer_space if it was dropped.
+      using Outcome = std::shared_ptr<std::optional<asio::error_code>>;
+
+      explicit WriteQueue(BufferPool& pool = BufferPool::defaultPool()) : pool(&pool) {}
+
+      void push(std::vector<ubyte_8>&& msg) {
+         push(pool->share(std::move(msg)));
+      }
+
+      void push(SharedBuffer msg, Outcome outcome = nullptr) {
+         queuedBytes += msg->size();
+         pending.push_back({ std::move(msg), std::move(outcome) });
+      }
+
+      const std::vector<asio::const_buffer>& prepare() {
+         writing = true;
+         buffers.clear();
+         while (!pending.empty()) {
+            inFlight.emplace_back(std::move(pending.front()));
+            pending.pop_front();
+            buffers.emplace_back(asio::buffer(*inFlight.back().msg));
+         }
+         return buffers;
+      }
+
+      // The release functions return how many bytes left the queue.
+      std::size_t complete(const asio::error_code& ec = {}) {
+         std::size_t released = 0;
+         for (auto& entry : inFlight) released += release(entry, ec);
+         queuedBytes -= released;
+         inFlight.clear();
+         buffers.clear();
+         writing = false;
+         return released;
+      }
+
+      // Messages of a write in flight stay alive until complete().
+      std::size_t clear() {
+         std::size_t released = 0;
+         for (auto& entry : pending) released += release(entry, asio::error::operation_aborted);
+         queuedBytes -= released;
+         pending.clear();
+         return released;
+      }
+
+      // Drops not yet written messages, oldest first, until at least bytes are gone.
+      std::size_t dropOldest(std::size_t bytes, std::size_t& droppedMessages) {
+         std::size_t released = 0;
+         while (released < bytes && !pending.empty()) {
+            released += release(pending.front(), asio::error::no_buffer_space);
+            pending.pop_front();
+            droppedMessages++;
+         }
+         queuedBytes -= released;
+         return released;
+      }
+
+      bool isWriting() const { return writing; }
+      bool hasPending() const { return !pending.empty(); }
+      std::size_t getQueuedBytes() const { return queuedBytes; }
+
+   private:
+      struct Entry {
+         SharedBuffer msg;
+         Outcome outcome;
+      };
+
+      static std::size_t release(Entry& entry, const asio::error_code& ec) {
+         if (entry.outcome) *entry.outcome = ec;
+         return entry.msg->size();
+      }
+
+      BufferPool* pool;
+      std::deque<Entry> pending;
+      std::vector<Entry> inFlight;
+      std::vector<asio::const_buffer> buffers;
+      std::size_t queuedBytes = 0;
+      bool writing = false;
+   };
+}
+
+#endif //NETWORK_WRITE_QUEUE_H
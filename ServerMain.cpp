@@ -3,45 +3,72 @@
 #include <VORTEX_MP/NestedLoops>
 
 #include "SRC/Util/StringUtil.h"
-#include "SRC/Networking/PacketNet.h"
+#include "SRC/Chat/ChatMessages.h"
 
 enum ServerCommand {
    SC_StartServer,
    SC_StopServer,
+   SC_Stats,
+   SC_Log,
    SC_Exit,
    SC_Message
 };
 
-class SimpleChatConnection : public PN::PacketNetConnection<> {
+class SimpleChatConnection : public PN::MessageNetConnection<Chat::Registry, PN::CompactPacket> {
 public:
-   using PN::PacketNetConnection<>::PacketNetConnection;
+   using PN::MessageNetConnection<Chat::Registry, PN::CompactPacket>::MessageNetConnection;
 protected:
-   void onPacket(const PN::DefaultPacket& data) override {
-      std::cout << "[Client]: " << StringUtil::bytesToString(data.data) << "\n";
+   void onMessage(const Chat::ChatLine& line) override {
+      // Only rooms the sender joined, otherwise any client could post anywhere.
+      if(!getServer().isInRoom(line.room, *this)) return;
+      std::cout << "[Client][" << line.room << "]: " << line.text << "\n";
 
-      std::string msg = StringUtil::bytesToString(data.data);
-
-      if(StringUtil::containsAny(msg, {"labda", "kacsa", "idk"})) {
+      if(StringUtil::containsAny(line.text, {"labda", "kacsa", "idk"})) {
          disconnect();
          return;
       }
 
-      asio::post(getContext(), [&, data]() {
-         for (auto& connection : getServer().getConnections()) {
-            if (connection.get() == this) continue;
-            connection->sendPacket(data);
-         }
-      });
+      // The line is only decoded for the filter, the frame it came in goes out as is.
+      auto notSender = [this](const PN::PacketNetConnection<PN::CompactPacket>& connection) {
+         return &connection != this;
+      };
+      if(received) getServer().publishFrame(line.room, received->shareFrame(getBufferPool()), notSender);
+      else getServer().publish(line.room, PN::CompactPacket(Chat::Registry::encode(line)), notSender);
+   }
+
+   void onMessage(const Chat::JoinRoom& msg) override {
+      getServer().joinAndReplay(msg.room, *this);
+   }
+
+   void onMessage(const Chat::LeaveRoom& msg) override {
+      getServer().leave(msg.room, *this);
    }
 
    void onStart() override {
+      usePacketViews = true;
+      negotiation.offer = true;
       sendHandshake();
    }
 
+   // Joining once the peer's handshake is in lets the replay go out in the negotiated framing.
+   void onHandshakeView(const PN::PacketView& pkt) override {
+      getServer().joinAndReplay(std::string(Chat::defaultRoom), *this);
+   }
+
+   void onPacketView(const PN::PacketView& pkt) override {
+      received = &pkt;
+      MessageNetConnection::onPacketView(pkt);
+      received = nullptr;
+   }
+
    void onEvent(Event evt) override {}
+
+private:
+   // The frame being dispatched, for onMessage to relay.
+   const PN::PacketView* received = nullptr;
 };
 
-class SimpleChatServer : public PN::PacketNetServer<> {
+class SimpleChatServer : public PN::PacketNetServer<PN::CompactPacket> {
 protected:
    void onStart() override {
       printServer("started", getPort(), true);
@@ -52,7 +79,7 @@ protected:
       return std::make_shared<SimpleChatConnection>(this->getContext(),*this, socket);
    }
 
-   void onDisconnect(std::shared_ptr<PN::PacketNetConnection<>> connection) override {
+   void onDisconnect(std::shared_ptr<PN::PacketNetConnection<PN::CompactPacket>> connection) override {
       printServer("client disconnected", getPort(), true);
    }
 };
@@ -68,6 +95,8 @@ int main(int argc, const char** argv) {
       {"/s", SC_StartServer},
       {"/stop", SC_StopServer},
       {"/d", SC_StopServer},
+      {"/stats", SC_Stats},
+      {"/log", SC_Log},
       {"/e", SC_Exit},
       {"/exit", SC_Exit}
    };
@@ -77,6 +106,8 @@ int main(int argc, const char** argv) {
    resetAnsiStyle();
 
    SimpleChatServer server;
+   server.setReadinessReads(true);
+   server.setHistory(50, 64 * 1024);
 
    NestedLoop nl;
    for (;;) {
@@ -106,6 +137,9 @@ int main(int argc, const char** argv) {
                continue;
             }
 
+            auto threadCount = StringUtil::parseArg<std::size_t>(args, 1);
+            server.setThreadCount(threadCount ? *threadCount : 1);
+
             server.start(*port);
             SN::StreamedNetServer::printServer("Server Created..", server.getPort(), true);
             break;
@@ -115,17 +149,45 @@ int main(int argc, const char** argv) {
             SN::StreamedNetServer::printServer("server closed");
             break;
          }
+         case SC_Stats: {
+            std::cout << server.getMetricsText();
+            break;
+         }
+         case SC_Log: {
+            auto dir = StringUtil::parseArg<std::string>(args, 0);
+            if(!dir) {
+               std::cerr << "incorrect arg usage\n";
+               continue;
+            }
+
+            if(server.isOnline()) {
+               std::cerr << "stop the server before setting the chat log\n";
+               continue;
+            }
+
+            auto log = std::make_shared<SN::FrameLog>();
+            log->setErrorHandler([](const std::string& error) {
+               std::cerr << "chat log failed: " << error << "\n";
+            });
+            if(!log->open(*dir)) {
+               std::cerr << "can't open chat log: " << log->getError() << "\n";
+               continue;
+            }
+            server.setLog(log);
+            SN::StreamedNetServer::printServer("logging to " + *dir);
+            break;
+         }
          default: {
             SN::StreamedNetServer::printServer(""+msg);
-            asio::post(server.getContext(), [&, msg]() {
-               for(auto& connection : server.getConnections()) {
-                  connection->sendPacket(StringUtil::stringToBytes(msg));
-               }
-            });
+            Chat::ChatLine line;
+            line.text = msg;
+            server.broadcast(PN::CompactPacket(Chat::Registry::encode(line)));
             break;
          }
       }
       NL_CHECK(nl, 0);
    }
+   // The pool threads have to be done before the server goes away.
+   server.close();
    return 0;
 }